@@ -3,7 +3,29 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Requests to a device without a submit operation are queued and
+   handed to its driver by a per-device I/O thread.  The queue is
+   kept sorted by sector and served in C-LOOK order: the thread
+   sweeps upward from the end of the previous transfer and then
+   jumps back to the lowest pending sector.  Queued requests for
+   adjacent sectors in the same direction are merged into a single
+   driver call of up to BLOCK_MERGE_MAX sectors.
+
+   A request never overtakes an earlier-submitted request that
+   overlaps it unless both are reads, so a read always sees the
+   data of every write submitted before it. */
+
+/* Most sectors in one merged driver call. */
+#define BLOCK_MERGE_MAX 32
+#define BLOCK_MERGE_PAGES (BLOCK_MERGE_MAX * BLOCK_SECTOR_SIZE / PGSIZE)
 
 /* A block device. */
 struct block
@@ -17,8 +39,18 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Statistics, protected by disabling interrupts. */
+    struct blkstat stats;               /* See lib/blkstat.h. */
+    block_sector_t last_end;            /* Sector after the last request. */
+
+    /* Request queue, unused if OPS has a submit operation. */
+    struct list queue;                  /* Pending requests, by sector. */
+    struct lock queue_lock;             /* Protects the queue members. */
+    struct condition queue_nonempty;    /* Signaled on submission. */
+    block_sector_t head;                /* Sector after last transfer. */
+    unsigned next_seq;                  /* Next submission number. */
+    uint8_t *merge_buffer;              /* Bounce buffer for merged requests,
+                                           null if merging is disabled. */
   };
 
 /* List of all block devices. */
@@ -28,6 +60,10 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void count_in_flight (struct block *);
+static void io_thread (void *);
+static void transfer_sync (struct block *, block_sector_t, block_sector_t,
+                           void *, bool write);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +156,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer_sync (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +167,343 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer_sync (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it transfer the whole run with a
+   single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, void *buffer)
+{
+  if (cnt > 0)
+    transfer_sync (block, sector, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  Drivers that support it transfer the whole run with a
+   single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer)
+{
+  if (cnt > 0)
+    transfer_sync (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Queues REQ on BLOCK and returns without waiting for it.
+   REQ->done is called once the transfer is complete. */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  ASSERT (req->cnt > 0);
+  check_sector (block, req->sector);
+  check_sector (block, req->sector + req->cnt - 1);
+  ASSERT (!req->write || block->type != BLOCK_FOREIGN);
+
+  old_level = intr_disable ();
+  if (req->write)
+    block->stats.write_cnt += req->cnt;
+  else
+    block->stats.read_cnt += req->cnt;
+  block->stats.requests++;
+  if (req->sector == block->last_end)
+    block->stats.sequential++;
+  block->last_end = req->sector + req->cnt;
+  if (block->ops->submit == NULL)
+    count_in_flight (block);
+  intr_set_level (old_level);
+  req->submit_time = timer_cycles ();
+
+  if (block->ops->submit != NULL)
+    {
+      block->ops->submit (block->aux, req);
+      return;
+    }
+
+  lock_acquire (&block->queue_lock);
+  req->seq = block->next_seq++;
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector > req->sector)
+      break;
+  list_insert (e, &req->elem);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Counts one more request in flight on BLOCK.  Interrupts must
+   be off. */
+static void
+count_in_flight (struct block *block)
+{
+  struct blkstat *st = &block->stats;
+
+  if (++st->in_flight > st->max_in_flight)
+    st->max_in_flight = st->in_flight;
+}
+
+/* Adds a latency of CYCLES to histogram HIST and to *TOTAL. */
+static void
+record_latency (uint64_t hist[BLKSTAT_BUCKETS], uint64_t *total,
+                uint64_t cycles)
+{
+  uint64_t x = cycles >> BLKSTAT_SHIFT;
+  int i;
+
+  for (i = 0; x != 0 && i < BLKSTAT_BUCKETS - 1; i++)
+    x >>= 1;
+  hist[i]++;
+  *total += cycles;
+}
+
+/* Notes that BLOCK, the device that carries out REQ, is starting
+   on it. */
+void
+block_start (struct block *block, struct block_request *req)
+{
+  struct blkstat *st = &block->stats;
+  enum intr_level old_level;
+
+  req->start_time = timer_cycles ();
+
+  old_level = intr_disable ();
+  if (block->ops->submit != NULL)
+    count_in_flight (block);
+  st->depth_sum += st->in_flight;
+  record_latency (st->queue_hist, &st->queue_cycles,
+                  req->start_time - req->submit_time);
+  intr_set_level (old_level);
+}
+
+/* Notes that BLOCK has completed REQ and calls REQ's
+   callback. */
+void
+block_complete (struct block *block, struct block_request *req)
+{
+  struct blkstat *st = &block->stats;
+  uint64_t now = timer_cycles ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  st->in_flight--;
+  st->completed++;
+  record_latency (st->service_hist, &st->service_cycles,
+                  now - req->start_time);
+  intr_set_level (old_level);
+
+  req->done (req);
+}
+
+/* Wakes up the thread waiting in transfer_sync() for REQ. */
+static void
+wake_submitter (struct block_request *req)
+{
+  sema_up (req->aux);
+}
+
+/* Submits a request to transfer CNT sectors starting at SECTOR
+   between BLOCK and BUFFER, and waits for it to complete. */
+static void
+transfer_sync (struct block *block, block_sector_t sector,
+               block_sector_t cnt, void *buffer, bool write)
+{
+  struct block_request req;
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  req.sector = sector;
+  req.cnt = cnt;
+  req.buffer = buffer;
+  req.write = write;
+  req.done = wake_submitter;
+  req.aux = &done;
+  block_submit (block, &req);
+  sema_down (&done);
+}
+
+/* Returns true if requests A and B touch a common sector. */
+static bool
+overlaps (const struct block_request *a, const struct block_request *b)
+{
+  return a->sector < b->sector + b->cnt && b->sector < a->sector + a->cnt;
+}
+
+/* Returns true if REQ may be dispatched now, that is, if no
+   request queued on BLOCK before it overlaps it, other than
+   reads overlapping a read.  BLOCK's queue_lock must be held. */
+static bool
+may_dispatch (struct block *block, const struct block_request *req)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      const struct block_request *q = list_entry (e, struct block_request,
+                                                  elem);
+      if (q->seq < req->seq && (q->write || req->write) && overlaps (q, req))
+        return false;
+    }
+  return true;
+}
+
+/* Moves the next requests to serve from BLOCK's queue to BATCH,
+   which must be empty: the first request in C-LOOK order, followed
+   by the requests that can be merged with it.  BLOCK's queue_lock
+   must be held and its queue must not be empty. */
+static void
+pick_batch (struct block *block, struct list *batch)
+{
+  struct block_request *first = NULL, *lowest = NULL, *req;
+  struct list_elem *e;
+  block_sector_t cnt;
+
+  /* The oldest request is always eligible, so this finds one. */
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      req = list_entry (e, struct block_request, elem);
+      if (!may_dispatch (block, req))
+        continue;
+      if (req->sector >= block->head)
+        {
+          first = req;
+          break;
+        }
+      if (lowest == NULL)
+        lowest = req;
+    }
+  if (first == NULL)
+    first = lowest;
+  ASSERT (first != NULL);
+
+  e = list_next (&first->elem);
+  list_remove (&first->elem);
+  list_push_back (batch, &first->elem);
+  cnt = first->cnt;
+
+  /* Merge requests that continue where the batch ends. */
+  while (block->merge_buffer != NULL && e != list_end (&block->queue))
+    {
+      req = list_entry (e, struct block_request, elem);
+      if (req->sector > first->sector + cnt)
+        break;
+      e = list_next (e);
+      if (req->sector == first->sector + cnt
+          && req->write == first->write
+          && cnt + req->cnt <= BLOCK_MERGE_MAX
+          && may_dispatch (block, req))
+        {
+          list_remove (&req->elem);
+          list_push_back (batch, &req->elem);
+          cnt += req->cnt;
+        }
+    }
+
+  block->head = first->sector + cnt;
+}
+
+/* Has BLOCK's driver transfer CNT sectors starting at SECTOR
+   between the device and BUFFER. */
+static void
+driver_transfer (struct block *block, block_sector_t sector,
+                 block_sector_t cnt, uint8_t *buffer, bool write)
+{
+  const struct block_operations *ops = block->ops;
+  block_sector_t i;
+
+  if (write && ops->write_multiple != NULL)
+    ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && ops->read_multiple != NULL)
+    ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      {
+        if (write)
+          ops->write (block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+        else
+          ops->read (block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+      }
+}
+
+/* Carries out the requests in BATCH, which pick_batch() built,
+   with a single driver call, then completes them.  Merged requests
+   go through BLOCK's bounce buffer. */
+static void
+dispatch (struct block *block, struct list *batch)
+{
+  struct block_request *first = list_entry (list_front (batch),
+                                            struct block_request, elem);
+  struct list_elem *e;
+  block_sector_t cnt = 0;
+  uint8_t *buffer;
+
+  if (list_next (&first->elem) == list_end (batch))
+    {
+      block_start (block, first);
+      cnt = first->cnt;
+      buffer = first->buffer;
+    }
+  else
+    {
+      buffer = block->merge_buffer;
+      for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+        {
+          struct block_request *req = list_entry (e, struct block_request,
+                                                  elem);
+          block_start (block, req);
+          if (req->write)
+            memcpy (buffer + cnt * BLOCK_SECTOR_SIZE, req->buffer,
+                    req->cnt * BLOCK_SECTOR_SIZE);
+          cnt += req->cnt;
+        }
+    }
+
+  driver_transfer (block, first->sector, cnt, buffer, first->write);
+
+  cnt = 0;
+  while (!list_empty (batch))
+    {
+      struct block_request *req = list_entry (list_pop_front (batch),
+                                              struct block_request, elem);
+      if (!req->write && buffer == block->merge_buffer)
+        memcpy (req->buffer, buffer + cnt * BLOCK_SECTOR_SIZE,
+                req->cnt * BLOCK_SECTOR_SIZE);
+      cnt += req->cnt;
+      block_complete (block, req);
+    }
+}
+
+/* Serves BLOCK's request queue forever. */
+static void
+io_thread (void *block_)
+{
+  struct block *block = block_;
+  struct list batch;
+
+  list_init (&batch);
+  for (;;)
+    {
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      pick_batch (block, &batch);
+      lock_release (&block->queue_lock);
+
+      dispatch (block, &batch);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +527,55 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Stores a copy of BLOCK's statistics in *ST. */
+void
+block_get_stats (struct block *block, struct blkstat *st)
+{
+  enum intr_level old_level = intr_disable ();
+  *st = block->stats;
+  intr_set_level (old_level);
+  st->cycles_per_ms = timer_cycles_per_ms ();
+}
+
+/* Prints CYCLES as microseconds, given the cycle counter rate
+   CYCLES_PER_MS, or as cycles if the rate is unknown. */
+static void
+print_cycles (uint64_t cycles, uint64_t cycles_per_ms)
+{
+  if (cycles_per_ms != 0)
+    printf ("%llu us", cycles * 1000 / cycles_per_ms);
+  else
+    printf ("%llu cycles", cycles);
+}
+
+/* Prints latency histogram HIST, labeled NAME, on one line. */
+static void
+print_histogram (const char *name, const uint64_t hist[BLKSTAT_BUCKETS],
+                 uint64_t cycles_per_ms)
+{
+  int i;
+
+  printf ("  %s:", name);
+  for (i = 0; i < BLKSTAT_BUCKETS; i++)
+    if (hist[i] != 0)
+      {
+        printf (i < BLKSTAT_BUCKETS - 1 ? " <" : " >=");
+        print_cycles ((uint64_t) 1 << (BLKSTAT_SHIFT
+                                       + (i < BLKSTAT_BUCKETS - 1
+                                          ? i : i - 1)),
+                      cycles_per_ms);
+        printf (" %llu", hist[i]);
+      }
+  printf ("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role, then latency and depth for each device that has carried
+   out requests. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -173,9 +585,34 @@ block_print_stats (void)
         {
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->stats.read_cnt, block->stats.write_cnt);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      struct blkstat st;
+
+      block_get_stats (block, &st);
+      if (st.completed == 0)
+        continue;
+
+      printf ("%s: %llu requests, %llu%% sequential, %llu bytes, "
+              "depth avg %llu.%llu max %u\n",
+              block->name, st.requests, st.sequential * 100 / st.requests,
+              (st.read_cnt + st.write_cnt) * BLOCK_SECTOR_SIZE,
+              st.depth_sum / st.completed,
+              st.depth_sum * 10 / st.completed % 10, st.max_in_flight);
+      printf ("  avg queue wait ");
+      print_cycles (st.queue_cycles / st.completed, st.cycles_per_ms);
+      printf (", avg service ");
+      print_cycles (st.service_cycles / st.completed, st.cycles_per_ms);
+      printf ("\n");
+      print_histogram ("queue wait", st.queue_hist, st.cycles_per_ms);
+      print_histogram ("service", st.service_hist, st.cycles_per_ms);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -198,8 +635,20 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->last_end = 0;
+
+  list_init (&block->queue);
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  block->head = 0;
+  block->next_seq = 0;
+  block->merge_buffer = NULL;
+  if (ops->submit == NULL)
+    {
+      block->merge_buffer = palloc_get_multiple (0, BLOCK_MERGE_PAGES);
+      thread_create (block->name, PRI_MAX, io_thread, block);
+    }
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <blkstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -49,15 +52,44 @@ struct block *block_get_by_name (const char *name);
 struct block *block_first (void);
 struct block *block_next (struct block *);
 
+/* An asynchronous block request.  The submitter fills in every
+   member up to AUX and passes the request to block_submit(), which
+   queues it.  Once the transfer is done, DONE is called with the
+   request, from the device's I/O thread, so it must not wait for
+   I/O on the same device.  The request must stay allocated until
+   then.  The block layer may change SECTOR while the request is
+   in flight, e.g. to translate partition-relative sectors. */
+struct block_request
+  {
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* Write, rather than read? */
+    void (*done) (struct block_request *);  /* Completion callback. */
+    void *aux;                          /* For use by DONE. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;              /* Element in device queue. */
+    unsigned seq;                       /* Order of submission. */
+    uint64_t submit_time;               /* Cycle count at submission. */
+    uint64_t start_time;                /* Cycle count at start. */
+  };
+
 /* Block device operations. */
 block_sector_t block_size (struct block *);
+void block_submit (struct block *, struct block_request *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
 /* Statistics. */
 void block_print_stats (void);
+void block_get_stats (struct block *, struct blkstat *);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,8 +97,29 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors in one request.
+       If null, the block layer falls back to READ or WRITE once
+       per sector. */
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const void *buffer);
+
+    /* Optional.  Takes over a request submitted to the device,
+       for devices such as partitions that only remap requests
+       onto other devices.  If null, requests are queued and fed
+       to the operations above by the device's I/O thread. */
+    void (*submit) (void *aux, struct block_request *);
   };
 
+/* For drivers with a submit operation that carry out requests
+   themselves, rather than passing them on to other devices:
+   block_start() must be called as the device starts on a request,
+   and block_complete() in place of calling its callback. */
+void block_start (struct block *, struct block_request *);
+void block_complete (struct block *, struct block_request *);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
@@ -5,13 +5,22 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data moves by bus-master DMA when the controller is a PCI IDE
+   controller with bus-master support, as the PIIX emulated by
+   QEMU and Bochs is, and the disk supports DMA.  Otherwise, and
+   after any DMA error, it moves by PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -24,6 +33,12 @@
 #define reg_status(CHANNEL) ((CHANNEL)->reg_base + 7)   /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status (CHANNEL)       /* Command (w/o). */
 
+/* Bus-master IDE port addresses, relative to the channel's
+   bus-master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* ATA control block port addresses.
    (If we supported non-legacy ATA controllers this would not be
    flexible enough, but it's fine for what we do.) */
@@ -34,6 +49,17 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits.  ERR and INTR are cleared by
+   writing 1s to them. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERR 0x02         /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Disk raised its interrupt. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +75,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Maximum number of sectors in a single READ/WRITE command.  A
+   sector count register value of 0 means 256. */
+#define MAX_SECTORS_PER_COMMAND 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +92,25 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt in READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Transfer data by DMA? */
+  };
+
+/* A physical region descriptor.  A PRD table is an array of
+   these, the last one marked with PRD_EOT, that tells the
+   bus master where in physical memory a transfer goes.  No region
+   may cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size of region in bytes, 0 = 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
   };
 
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -72,6 +124,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master I/O base, 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -84,9 +139,14 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static void enable_multiple_mode (struct ata_disk *, int);
+
+static void select_sectors (struct ata_disk *, block_sector_t, int);
+static void pio_read (struct ata_disk *, block_sector_t, int, void *);
+static void pio_write (struct ata_disk *, block_sector_t, int, const void *);
+static bool dma_transfer (struct ata_disk *, block_sector_t, int, void *,
+                          bool write);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -101,8 +161,19 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  struct pci_device pci;
+  uint16_t bm_base = 0;
   size_t chan_no;
 
+  /* Look for a PCI IDE controller's bus-master registers, which
+     BAR 4 maps to 16 ports, 8 per channel. */
+  if (pci_find_class (0x01, 0x01, &pci))
+    {
+      bm_base = pci_io_base (&pci, 4);
+      if (bm_base != 0)
+        pci_enable_bus_master (&pci);
+    }
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +197,14 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +215,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -272,7 +353,7 @@ identify_ata_device (struct ata_disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -289,6 +370,13 @@ identify_ata_device (struct ata_disk *d)
   snprintf (extra_info, sizeof extra_info,
             "model \"%s\", serial \"%s\"", model, serial);
 
+  /* Word 47 gives the most sectors the disk can transfer per
+     interrupt with READ/WRITE MULTIPLE, 0 if unsupported. */
+  enable_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Bit 8 of word 49 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
@@ -309,6 +397,28 @@ identify_ata_device (struct ata_disk *d)
   partition_scan (block);
 }
 
+/* Tries to put disk D in multiple mode with BLOCK_SIZE sectors
+   per interrupt, and records the outcome in D's multiple
+   member.  Leaves multiple mode off if BLOCK_SIZE is 0 or the
+   disk rejects the command. */
+static void
+enable_multiple_mode (struct ata_disk *d, int block_size)
+{
+  struct channel *c = d->channel;
+
+  d->multiple = 0;
+  if (block_size <= 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), block_size);
+  issue_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = block_size;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +447,263 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Each
+   command transfers up to MAX_SECTORS_PER_COMMAND sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                   void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      int n = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+      if (!dma_transfer (d, sec_no, n, buffer, false))
+        pio_read (d, sec_no, n, buffer);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.  Each
+   command transfers up to MAX_SECTORS_PER_COMMAND sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                    const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      int n = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+      if (!dma_transfer (d, sec_no, n, (void *) buffer, true))
+        pio_write (d, sec_no, n, buffer);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    NULL
   };
-
+
+/* Reads CNT sectors, at most MAX_SECTORS_PER_COMMAND, starting
+   at SEC_NO from disk D into BUFFER by PIO.  In multiple mode the
+   disk interrupts once per D->multiple sectors rather than once
+   per sector.  D's channel must be locked. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, int cnt, void *buffer_)
+{
+  struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  int per_intr = d->multiple > 0 ? d->multiple : 1;
+  int done;
+
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, d->multiple > 0 ? CMD_READ_MULTIPLE
+                                    : CMD_READ_SECTOR_RETRY);
+  for (done = 0; done < cnt; )
+    {
+      int i;
+
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no + done);
+      for (i = 0; i < per_intr && done < cnt; i++, done++)
+        {
+          input_sector (c, buffer);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+    }
+}
+
+/* Writes CNT sectors, at most MAX_SECTORS_PER_COMMAND, starting
+   at SEC_NO to disk D from BUFFER by PIO, batching interrupts as
+   pio_read() does.  D's channel must be locked. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, int cnt,
+           const void *buffer_)
+{
+  struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  int per_intr = d->multiple > 0 ? d->multiple : 1;
+  int done;
+
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                                    : CMD_WRITE_SECTOR_RETRY);
+  for (done = 0; done < cnt; )
+    {
+      int i;
+
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no + done);
+      for (i = 0; i < per_intr && done < cnt; i++, done++)
+        {
+          output_sector (c, buffer);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+      sema_down (&c->completion_wait);
+    }
+}
+
+/* Returns true if the SIZE bytes at BUFFER lie in the kernel's
+   direct mapping of physical memory, false if any of them are
+   user memory or kernel memory mapped elsewhere, such as by
+   vmalloc(). */
+static bool
+is_direct_mapped (const void *buffer, size_t size)
+{
+  const uint8_t *end = ptov ((uintptr_t) init_ram_pages * PGSIZE);
+
+  return (is_kernel_vaddr (buffer)
+          && (const uint8_t *) buffer < end
+          && size <= (size_t) (end - (const uint8_t *) buffer));
+}
+
+/* Fills channel C's PRD table to describe the SIZE bytes at
+   kernel virtual address BUFFER.  The buffer is translated one
+   page at a time, so it need not be physically contiguous;
+   physically adjacent pages share a descriptor as long as it
+   stays within a 64 kB boundary. */
+static void
+build_prdt (struct channel *c, const uint8_t *buffer, size_t size)
+{
+  struct prd *prd = c->prdt;
+  size_t prd_cnt = 0;
+
+  while (size > 0)
+    {
+      uintptr_t addr = vtop (buffer);
+      size_t chunk = PGSIZE - pg_ofs (buffer);
+      if (chunk > size)
+        chunk = size;
+
+      if (prd_cnt > 0
+          && prd[-1].addr + (prd[-1].size ? prd[-1].size : 0x10000) == addr
+          && (addr & 0xffff) != 0)
+        prd[-1].size += chunk;
+      else
+        {
+          ASSERT (prd_cnt < PRD_CNT);
+          prd->addr = addr;
+          prd->size = chunk;
+          prd->flags = 0;
+          prd++;
+          prd_cnt++;
+        }
+      buffer += chunk;
+      size -= chunk;
+    }
+  prd[-1].flags = PRD_EOT;
+}
+
+/* Transfers CNT sectors, at most MAX_SECTORS_PER_COMMAND,
+   starting at SEC_NO between disk D and BUFFER by bus-master DMA,
+   from the disk if WRITE is false and to it otherwise.  The
+   calling thread sleeps on the channel's completion_wait until
+   the disk interrupts, leaving the CPU to other threads.  D's
+   channel must be locked.
+
+   Returns false without doing anything if D does not use DMA, if
+   BUFFER is not word aligned, or if BUFFER is not in the kernel's
+   direct mapping of physical memory, where vtop() can translate
+   it.  If the transfer fails, turns DMA off for D and returns
+   false.  Either way the caller falls back to PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, int cnt,
+              void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status, status;
+
+  if (!d->dma || (uintptr_t) buffer % 2 != 0
+      || !is_direct_mapped (buffer, (size_t) cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  build_prdt (c, buffer, (size_t) cnt * BLOCK_SECTOR_SIZE);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  outb (reg_bm_command (c), direction);
+
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & (BM_STA_ERR | BM_STA_ACTIVE)) != 0
+      || (status & (STA_BSY | STA_DRQ | STA_ERR)) != 0)
+    {
+      printf ("%s: DMA %s failed at sector %"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+      return false;
+    }
+  return true;
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, at most
+   MAX_SECTORS_PER_COMMAND, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, int cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_COMMAND);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_COMMAND ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -402,9 +712,9 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt.  Used for PIO and DMA commands alike. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
@@ -317,8 +317,21 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Passes REQ, which is relative to partition P, on to the
+   request queue of the block device that contains P. */
+static void
+partition_submit (void *p_, struct block_request *req)
+{
+  struct partition *p = p_;
+  req->sector += p->start;
+  block_submit (p->block, req);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    NULL,
+    NULL,
+    partition_submit
   };
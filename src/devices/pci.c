@@ -0,0 +1,165 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* This code is a minimal interface to PCI configuration space,
+   using configuration mechanism #1, which every PC chipset that
+   Pintos runs on supports.  It does just enough for drivers to
+   find their device, locate its I/O ports and enable bus
+   mastering.  See [PCI] for hardware details. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8        /* Selects a config register. */
+#define PCI_CONFIG_DATA 0xcfc           /* Reads or writes it. */
+
+/* Limits of the bus topology that we scan. */
+#define PCI_BUS_CNT 256
+#define PCI_DEV_CNT 32
+#define PCI_FUNC_CNT 8
+
+static uint32_t config_address (int bus, int dev, int func, uint8_t reg);
+static uint32_t config_read (int bus, int dev, int func, uint8_t reg);
+static bool scan (bool (*match) (const struct pci_device *, uint32_t,
+                                 uint32_t),
+                  uint32_t a, uint32_t b, int n, struct pci_device *);
+
+/* Returns true if D has base class A and sub-class B. */
+static bool
+match_class (const struct pci_device *d, uint32_t a, uint32_t b)
+{
+  return d->class == a && d->subclass == b;
+}
+
+/* Returns true if D has vendor ID A and device ID B. */
+static bool
+match_id (const struct pci_device *d, uint32_t a, uint32_t b)
+{
+  return d->vendor_id == a && d->device_id == b;
+}
+
+/* Finds the first PCI function with the given CLASS and
+   SUBCLASS and stores it in *D.  Returns true if successful,
+   false if there is none. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_device *d)
+{
+  return scan (match_class, class, subclass, 0, d);
+}
+
+/* Finds PCI function number N, counting from 0 in bus order,
+   among those with the given VENDOR_ID and DEVICE_ID and stores
+   it in *D.  Returns true if successful, false if there are not
+   that many. */
+bool
+pci_find_id (uint16_t vendor_id, uint16_t device_id, int n,
+             struct pci_device *d)
+{
+  return scan (match_id, vendor_id, device_id, n, d);
+}
+
+/* Returns the 32-bit configuration register at offset REG of D.
+   REG must be a multiple of 4. */
+uint32_t
+pci_read_config (const struct pci_device *d, uint8_t reg)
+{
+  return config_read (d->bus, d->dev, d->func, reg);
+}
+
+/* Writes VALUE to the 32-bit configuration register at offset
+   REG of D.  REG must be a multiple of 4. */
+void
+pci_write_config (const struct pci_device *d, uint8_t reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDRESS, config_address (d->bus, d->dev, d->func, reg));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Returns the I/O port base of base address register BAR of D,
+   or 0 if BAR is unassigned or maps memory instead of I/O
+   ports. */
+uint16_t
+pci_io_base (const struct pci_device *d, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (d, PCI_REG_BAR0 + bar * 4);
+  return (value & 1) != 0 ? value & 0xfffc : 0;
+}
+
+/* Returns the legacy interrupt line that the BIOS routed D to. */
+uint8_t
+pci_irq (const struct pci_device *d)
+{
+  return pci_read_config (d, PCI_REG_IRQ) & 0xff;
+}
+
+/* Allows D to initiate DMA transfers on the bus. */
+void
+pci_enable_bus_master (const struct pci_device *d)
+{
+  uint32_t cmd = pci_read_config (d, PCI_REG_COMMAND);
+  pci_write_config (d, PCI_REG_COMMAND,
+                    (cmd & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+}
+
+/* Returns the CONFIG_ADDRESS value that selects configuration
+   register REG of function FUNC of device DEV on bus BUS. */
+static uint32_t
+config_address (int bus, int dev, int func, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  return 0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg;
+}
+
+/* Reads configuration register REG of function FUNC of device
+   DEV on bus BUS. */
+static uint32_t
+config_read (int bus, int dev, int func, uint8_t reg)
+{
+  outl (PCI_CONFIG_ADDRESS, config_address (bus, dev, func, reg));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Walks every present PCI function and stores into *D the one
+   for which MATCH, passed A and B, returns true for the (N+1)th
+   time.  Returns true if a function was found. */
+static bool
+scan (bool (*match) (const struct pci_device *, uint32_t, uint32_t),
+      uint32_t a, uint32_t b, int n, struct pci_device *d)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < PCI_BUS_CNT; bus++)
+    for (dev = 0; dev < PCI_DEV_CNT; dev++)
+      for (func = 0; func < PCI_FUNC_CNT; func++)
+        {
+          uint32_t id = config_read (bus, dev, func, PCI_REG_ID);
+          uint32_t class;
+
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* Function 0 absent means the whole device is. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          class = config_read (bus, dev, func, PCI_REG_CLASS);
+          d->bus = bus;
+          d->dev = dev;
+          d->func = func;
+          d->vendor_id = id & 0xffff;
+          d->device_id = id >> 16;
+          d->class = class >> 24;
+          d->subclass = (class >> 16) & 0xff;
+          if (match (d, a, b) && n-- == 0)
+            return true;
+
+          /* Only multi-function devices have functions past 0. */
+          if (func == 0
+              && !(config_read (bus, dev, 0, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+  return false;
+}
@@ -0,0 +1,140 @@
+#include "devices/ramdisk.h"
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory.
+
+   The contents live in pages from the kernel pool, which need not
+   be contiguous, and are lost at power off.  Because it takes no
+   emulated device time, a RAM disk in the file system or scratch
+   role lets the cache, inode and directory code be measured on
+   their own.  An optional delay per driver call models a slower
+   device; the block layer still queues and merges requests to a
+   RAM disk as it does for a disk. */
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Pages holding the contents. */
+    size_t page_cnt;            /* Number of pages. */
+    int latency;                /* Delay per driver call, in us. */
+  };
+
+static struct ramdisk ramdisk;
+static struct block_operations ramdisk_operations;
+
+/* Creates a zero-filled RAM disk of SIZE_KB kB, rounded up to a
+   whole page, and registers it as "ram0" with the given TYPE.
+   Each transfer from or to it is delayed by LATENCY_US
+   microseconds. */
+void
+ramdisk_init (enum block_type type, size_t size_kb, int latency_us)
+{
+  struct ramdisk *r = &ramdisk;
+  char extra_info[32];
+  size_t i;
+
+  r->page_cnt = DIV_ROUND_UP (size_kb * 1024, PGSIZE);
+  r->latency = latency_us;
+  r->pages = malloc (r->page_cnt * sizeof *r->pages);
+  if (r->page_cnt == 0 || r->pages == NULL)
+    PANIC ("ramdisk: cannot allocate %zu kB", size_kb);
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      r->pages[i] = palloc_get_page (PAL_ZERO);
+      if (r->pages[i] == NULL)
+        PANIC ("ramdisk: out of memory after %zu kB", i * PGSIZE / 1024);
+    }
+
+  snprintf (extra_info, sizeof extra_info, "RAM, %d us latency",
+            r->latency);
+  block_register ("ram0", type, extra_info, r->page_cnt * SECTORS_PER_PAGE,
+                  &ramdisk_operations, r);
+}
+
+/* Returns the address of sector SECTOR of R. */
+static uint8_t *
+sector_addr (const struct ramdisk *r, block_sector_t sector)
+{
+  return (r->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Copies CNT sectors starting at SECTOR between R and BUFFER,
+   after R's delay. */
+static void
+transfer (struct ramdisk *r, block_sector_t sector, block_sector_t cnt,
+          uint8_t *buffer, bool write)
+{
+  if (r->latency > 0)
+    timer_usleep (r->latency);
+
+  while (cnt > 0)
+    {
+      /* Copy up to the end of the page. */
+      block_sector_t chunk = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+      size_t size;
+
+      if (chunk > cnt)
+        chunk = cnt;
+      size = chunk * BLOCK_SECTOR_SIZE;
+      if (write)
+        memcpy (sector_addr (r, sector), buffer, size);
+      else
+        memcpy (buffer, sector_addr (r, sector), size);
+
+      sector += chunk;
+      buffer += size;
+      cnt -= chunk;
+    }
+}
+
+/* Reads sector SECTOR from RAM disk R into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *r, block_sector_t sector, void *buffer)
+{
+  transfer (r, sector, 1, buffer, false);
+}
+
+/* Writes sector SECTOR to RAM disk R from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *r, block_sector_t sector, const void *buffer)
+{
+  transfer (r, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SECTOR from RAM disk R into
+   BUFFER. */
+static void
+ramdisk_read_multiple (void *r, block_sector_t sector, block_sector_t cnt,
+                       void *buffer)
+{
+  transfer (r, sector, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SECTOR to RAM disk R from
+   BUFFER. */
+static void
+ramdisk_write_multiple (void *r, block_sector_t sector, block_sector_t cnt,
+                        const void *buffer)
+{
+  transfer (r, sector, cnt, (void *) buffer, true);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL
+  };
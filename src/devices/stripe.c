@@ -0,0 +1,218 @@
+#include "devices/stripe.h"
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A striping ("RAID-0") block device.
+
+   The sectors of the striped device are dealt out across its
+   member devices in chunks of STRIPE_CHUNK sectors: chunk 0 goes
+   to the first member, chunk 1 to the second, and so on, wrapping
+   around after the last member.  A request that spans several
+   chunks is split into one request per chunk, and each piece is
+   queued on its member right away, so members on different IDE
+   channels, which have separate controllers and interrupts,
+   transfer their pieces at the same time.  Pieces that land next
+   to each other on one member are merged again by that member's
+   request queue.
+
+   Every member contributes the same number of sectors, the size
+   of the smallest member rounded down to a whole chunk.  There is
+   no on-disk metadata: the same members must be given in the same
+   order on every boot. */
+
+/* Sectors per chunk. */
+#define STRIPE_CHUNK 8
+
+/* Most member devices. */
+#define STRIPE_MAX 4
+
+/* The striped device. */
+struct stripe
+  {
+    struct block *members[STRIPE_MAX];  /* Member devices, in order. */
+    int member_cnt;                     /* Number of members. */
+  };
+
+/* A request to the striped device in flight on its members. */
+struct stripe_io
+  {
+    struct block_request *req;          /* Request being served. */
+    struct lock lock;                   /* Protects PENDING. */
+    int pending;                        /* Pieces not yet complete. */
+    struct block_request pieces[];      /* Per-chunk requests. */
+  };
+
+static struct stripe stripe;
+static struct block_operations stripe_operations;
+
+/* Sets up a striped device named "stripe" over the block devices
+   named in MEMBERS, a comma-separated list, and registers it as a
+   file system device. */
+void
+stripe_init (char *members)
+{
+  block_sector_t member_size = 0;
+  char *name, *save_ptr;
+  int i;
+
+  for (name = strtok_r (members, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("stripe: no such block device \"%s\"", name);
+      if (stripe.member_cnt >= STRIPE_MAX)
+        PANIC ("stripe: more than %d members", STRIPE_MAX);
+      for (i = 0; i < stripe.member_cnt; i++)
+        if (stripe.members[i] == block)
+          PANIC ("stripe: %s given twice", name);
+
+      if (stripe.member_cnt == 0 || block_size (block) < member_size)
+        member_size = block_size (block);
+      stripe.members[stripe.member_cnt++] = block;
+    }
+  if (stripe.member_cnt == 0)
+    PANIC ("stripe: no member devices");
+
+  member_size -= member_size % STRIPE_CHUNK;
+  if (member_size == 0)
+    PANIC ("stripe: member devices are too small");
+
+  block_register ("stripe", BLOCK_FILESYS, NULL,
+                  member_size * stripe.member_cnt, &stripe_operations,
+                  &stripe);
+}
+
+/* Maps SECTOR of stripe S to a member device, which is returned,
+   and the sector within that member, which is stored in
+   *MEMBER_SECTOR. */
+static struct block *
+map_sector (const struct stripe *s, block_sector_t sector,
+            block_sector_t *member_sector)
+{
+  block_sector_t chunk = sector / STRIPE_CHUNK;
+
+  *member_sector = (chunk / s->member_cnt * STRIPE_CHUNK
+                    + sector % STRIPE_CHUNK);
+  return s->members[chunk % s->member_cnt];
+}
+
+/* Reads sector SECTOR from stripe S into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+stripe_read (void *s_, block_sector_t sector, void *buffer)
+{
+  struct stripe *s = s_;
+  block_sector_t member_sector;
+  struct block *member = map_sector (s, sector, &member_sector);
+
+  block_read (member, member_sector, buffer);
+}
+
+/* Writes sector SECTOR to stripe S from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+stripe_write (void *s_, block_sector_t sector, const void *buffer)
+{
+  struct stripe *s = s_;
+  block_sector_t member_sector;
+  struct block *member = map_sector (s, sector, &member_sector);
+
+  block_write (member, member_sector, buffer);
+}
+
+/* Completes a piece of a stripe_io, and the request it belongs
+   to if it was the last piece. */
+static void
+piece_done (struct block_request *piece)
+{
+  struct stripe_io *io = piece->aux;
+  bool last;
+
+  lock_acquire (&io->lock);
+  last = --io->pending == 0;
+  lock_release (&io->lock);
+
+  if (last)
+    {
+      io->req->done (io->req);
+      free (io);
+    }
+}
+
+/* Splits REQ, which is relative to stripe S, at chunk boundaries
+   and queues each piece on its member device. */
+static void
+stripe_submit (void *s_, struct block_request *req)
+{
+  struct stripe *s = s_;
+  block_sector_t first = req->sector % STRIPE_CHUNK;
+  int piece_cnt = DIV_ROUND_UP (first + req->cnt, STRIPE_CHUNK);
+  struct stripe_io *io;
+  block_sector_t ofs, cnt;
+  int i;
+
+  io = malloc (sizeof *io + piece_cnt * sizeof *io->pieces);
+  if (io == NULL)
+    {
+      /* Out of memory: transfer the pieces one at a time. */
+      for (ofs = 0; ofs < req->cnt; ofs += cnt)
+        {
+          block_sector_t member_sector;
+          struct block *member = map_sector (s, req->sector + ofs,
+                                             &member_sector);
+          uint8_t *buffer = (uint8_t *) req->buffer + ofs * BLOCK_SECTOR_SIZE;
+
+          cnt = STRIPE_CHUNK - (req->sector + ofs) % STRIPE_CHUNK;
+          if (cnt > req->cnt - ofs)
+            cnt = req->cnt - ofs;
+          if (req->write)
+            block_write_multiple (member, member_sector, cnt, buffer);
+          else
+            block_read_multiple (member, member_sector, cnt, buffer);
+        }
+      req->done (req);
+      return;
+    }
+
+  io->req = req;
+  lock_init (&io->lock);
+  io->pending = piece_cnt;
+
+  /* Fill in every piece before submitting any, since the last one
+     to complete frees IO. */
+  for (i = 0, ofs = 0; i < piece_cnt; i++, ofs += cnt)
+    {
+      struct block_request *piece = &io->pieces[i];
+
+      cnt = STRIPE_CHUNK - (req->sector + ofs) % STRIPE_CHUNK;
+      if (cnt > req->cnt - ofs)
+        cnt = req->cnt - ofs;
+      piece->cnt = cnt;
+      piece->buffer = (uint8_t *) req->buffer + ofs * BLOCK_SECTOR_SIZE;
+      piece->write = req->write;
+      piece->done = piece_done;
+      piece->aux = io;
+    }
+  for (i = 0, ofs = 0; i < piece_cnt; i++, ofs += cnt)
+    {
+      struct block_request *piece = &io->pieces[i];
+      struct block *member = map_sector (s, req->sector + ofs,
+                                         &piece->sector);
+      cnt = piece->cnt;
+      block_submit (member, piece);
+    }
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_read,
+    stripe_write,
+    NULL,
+    NULL,
+    stripe_submit
+  };
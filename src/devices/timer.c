@@ -29,6 +29,9 @@ static struct list blocked_list;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Cycle counter reading when the timer was started. */
+static uint64_t start_cycles;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
@@ -45,6 +48,7 @@ timer_init (void)
   
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  start_cycles = timer_cycles ();
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -92,6 +96,27 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the CPU's cycle counter, which counts up at a fixed
+   rate much higher than TIMER_FREQ. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t cycles;
+  asm volatile ("rdtsc" : "=A" (cycles));
+  return cycles;
+}
+
+/* Returns the number of timer_cycles() per millisecond, as
+   measured against the timer since it was started, or 0 if too
+   little time has passed to tell. */
+uint64_t
+timer_cycles_per_ms (void)
+{
+  int64_t t = timer_ticks ();
+  uint64_t cycles = timer_cycles () - start_cycles;
+  return t > 0 ? cycles * TIMER_FREQ / (t * 1000) : 0;
+}
+
 /* less_list_func used by timer_sleep when determining the
    thread with the least number of ticks before being awoken. */
 bool
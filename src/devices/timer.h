@@ -13,6 +13,10 @@ void timer_calibrate (void);
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* Cycle counter. */
+uint64_t timer_cycles (void);
+uint64_t timer_cycles_per_ms (void);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
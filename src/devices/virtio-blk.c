@@ -0,0 +1,471 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio block devices in
+   the "legacy" PCI flavor, which QEMU offers with
+   `-drive if=virtio'.  See [VIRTIO] for the specification.
+
+   The device has a single request queue, a ring of descriptors
+   in memory shared with the device.  Each request takes a header
+   descriptor naming the operation and sector, one descriptor per
+   physically contiguous piece of the data buffer, and one for a
+   status byte for the device to fill in.  Requests
+   are placed on the queue as soon as they are submitted, so the
+   device can work on many at once.  The device raises an interrupt
+   when it has completed requests, and a per-disk completion thread
+   then calls their callbacks. */
+
+/* PCI IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Most virtio block devices that we drive. */
+#define DISK_CNT 8
+
+/* Legacy virtio registers, as offsets from I/O BAR 0. */
+#define REG_HOST_FEATURES 0x00  /* Features offered by the device. */
+#define REG_GUEST_FEATURES 0x04 /* Features accepted by the driver. */
+#define REG_QUEUE_PFN 0x08      /* Physical page number of the queue. */
+#define REG_QUEUE_SIZE 0x0c     /* Number of descriptors in the queue. */
+#define REG_QUEUE_SELECT 0x0e   /* Queue that the above refer to. */
+#define REG_QUEUE_NOTIFY 0x10   /* Written to announce new requests. */
+#define REG_STATUS 0x12         /* Device status. */
+#define REG_ISR 0x13            /* Interrupt status, cleared on read. */
+#define REG_CAPACITY 0x14       /* Capacity in sectors, 64 bits. */
+
+/* Device status bits. */
+#define STA_ACKNOWLEDGE 0x01    /* Driver found the device. */
+#define STA_DRIVER 0x02         /* Driver knows how to drive it. */
+#define STA_DRIVER_OK 0x04      /* Driver is ready. */
+#define STA_FAILED 0x80         /* Driver gave up on it. */
+
+/* Interrupt status bits. */
+#define ISR_QUEUE 0x01          /* A queue has completed requests. */
+
+/* Alignment of the used ring within the queue. */
+#define QUEUE_ALIGN 4096
+
+/* A descriptor: one buffer of a request. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* DESC_* flags. */
+    uint16_t next;              /* Next descriptor, if DESC_NEXT. */
+  };
+
+#define DESC_NEXT 0x1           /* Request continues at NEXT. */
+#define DESC_WRITE 0x2          /* Device writes the buffer. */
+
+/* The ring of requests made available to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Incremented per new request. */
+    uint16_t ring[];            /* Head descriptor of each request. */
+  };
+
+/* The ring of requests the device has completed. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head descriptor of the request. */
+    uint32_t len;               /* Bytes the device wrote. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Incremented per completed request. */
+    struct vring_used_elem ring[];
+  };
+
+/* Request header, read by the device. */
+struct virtio_blk_header
+  {
+    uint32_t type;              /* TYPE_IN or TYPE_OUT. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+
+#define TYPE_IN 0               /* Read. */
+#define TYPE_OUT 1              /* Write. */
+
+/* The header and status of a request in flight, indexed by its
+   head descriptor. */
+struct slot
+  {
+    struct virtio_blk_header header;
+    uint8_t status;             /* 0 on success, written by device. */
+    struct block_request *req;  /* Request being carried out. */
+  };
+
+/* A virtio block device. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base of the legacy registers. */
+    uint8_t irq;                /* Interrupt vector number. */
+    struct block *block;        /* Registered block device. */
+
+    struct lock lock;           /* Protects the members below. */
+    uint16_t queue_size;        /* Descriptors in the queue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t last_used;         /* Used ring entries consumed. */
+    struct slot *slots;         /* One per descriptor. */
+    uint16_t free_head;         /* First free descriptor. */
+    int free_cnt;               /* Number of free descriptors. */
+    struct condition desc_free; /* Signaled when descriptors free up. */
+
+    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+  };
+
+static struct virtio_disk disks[DISK_CNT];
+static int disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool init_queue (struct virtio_disk *);
+static void completion_thread (void *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds virtio block devices and registers them with the block
+   device layer. */
+void
+virtio_blk_init (void)
+{
+  struct pci_device pci;
+  int i;
+
+  for (i = 0; disk_cnt < DISK_CNT
+         && pci_find_id (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, i, &pci);
+       i++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+      block_sector_t capacity;
+      int j;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + disk_cnt);
+      d->io_base = pci_io_base (&pci, 0);
+      d->irq = pci_irq (&pci) + 0x20;
+      if (d->io_base == 0 || d->irq >= 0x30)
+        {
+          printf ("%s: no I/O ports or interrupt, ignoring\n", d->name);
+          continue;
+        }
+      pci_enable_bus_master (&pci);
+
+      /* Reset the device, tell it we are here, accept none of its
+         optional features, and set up its request queue. */
+      outb (d->io_base + REG_STATUS, 0);
+      outb (d->io_base + REG_STATUS, STA_ACKNOWLEDGE);
+      outb (d->io_base + REG_STATUS, STA_ACKNOWLEDGE | STA_DRIVER);
+      outl (d->io_base + REG_GUEST_FEATURES, 0);
+      if (!init_queue (d))
+        {
+          printf ("%s: cannot set up request queue, ignoring\n", d->name);
+          outb (d->io_base + REG_STATUS, STA_FAILED);
+          continue;
+        }
+
+      lock_init (&d->lock);
+      cond_init (&d->desc_free);
+      sema_init (&d->completion_wait, 0);
+
+      /* Devices may share an interrupt line. */
+      for (j = 0; j < disk_cnt; j++)
+        if (disks[j].irq == d->irq)
+          break;
+      if (j == disk_cnt)
+        intr_register_ext (d->irq, interrupt_handler, d->name);
+      disk_cnt++;
+
+      thread_create (d->name, PRI_MAX, completion_thread, d);
+      outb (d->io_base + REG_STATUS,
+            STA_ACKNOWLEDGE | STA_DRIVER | STA_DRIVER_OK);
+
+      /* Register.  The high 32 bits of the capacity must be 0 for
+         a block_sector_t to address the whole disk. */
+      capacity = inl (d->io_base + REG_CAPACITY);
+      if (inl (d->io_base + REG_CAPACITY + 4) != 0)
+        capacity = UINT32_MAX;
+      d->block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                                 &virtio_operations, d);
+      partition_scan (d->block);
+    }
+}
+
+/* Allocates request queue 0 of D and hands it to the device.
+   Returns true if successful, false on failure. */
+static bool
+init_queue (struct virtio_disk *d)
+{
+  size_t avail_end, used_ofs, page_cnt;
+  uint8_t *queue;
+  int i;
+
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  if (d->queue_size < 3)
+    return false;
+
+  /* The descriptor table and available ring come first, and the
+     used ring follows at the next QUEUE_ALIGN boundary.  The
+     queue must be physically contiguous, as kernel pool pages
+     allocated together are. */
+  avail_end = (d->queue_size * sizeof *d->desc
+               + sizeof *d->avail + (d->queue_size + 1) * sizeof (uint16_t));
+  used_ofs = ROUND_UP (avail_end, QUEUE_ALIGN);
+  page_cnt = DIV_ROUND_UP (used_ofs + sizeof *d->used + sizeof (uint16_t)
+                           + d->queue_size * sizeof *d->used->ring, PGSIZE);
+  queue = palloc_get_multiple (PAL_ZERO, page_cnt);
+  d->slots = malloc (d->queue_size * sizeof *d->slots);
+  if (queue == NULL || d->slots == NULL)
+    {
+      palloc_free_multiple (queue, page_cnt);
+      free (d->slots);
+      return false;
+    }
+
+  d->desc = (struct vring_desc *) queue;
+  d->avail = (struct vring_avail *) (queue + d->queue_size * sizeof *d->desc);
+  d->used = (struct vring_used *) (queue + used_ofs);
+  d->last_used = 0;
+
+  /* Chain every descriptor into the free list. */
+  for (i = 0; i < d->queue_size; i++)
+    d->desc[i].next = i + 1;
+  d->free_head = 0;
+  d->free_cnt = d->queue_size;
+
+  outl (d->io_base + REG_QUEUE_PFN, vtop (queue) / PGSIZE);
+  return true;
+}
+
+/* Takes a descriptor off D's free list and returns its index.
+   D's lock must be held and a descriptor must be free. */
+static uint16_t
+alloc_desc (struct virtio_disk *d)
+{
+  uint16_t i = d->free_head;
+
+  ASSERT (d->free_cnt > 0);
+  d->free_head = d->desc[i].next;
+  d->free_cnt--;
+  return i;
+}
+
+/* Returns the chain of descriptors starting at HEAD to D's free
+   list.  D's lock must be held. */
+static void
+free_chain (struct virtio_disk *d, uint16_t head)
+{
+  uint16_t i = head;
+
+  for (;;)
+    {
+      bool more = (d->desc[i].flags & DESC_NEXT) != 0;
+      uint16_t next = d->desc[i].next;
+
+      d->desc[i].next = d->free_head;
+      d->free_head = i;
+      d->free_cnt++;
+      if (!more)
+        break;
+      i = next;
+    }
+}
+
+/* Returns the physical address of kernel virtual address VADDR,
+   found in the kernel's page tables.  Unlike vtop(), this works
+   for memory outside the direct mapping of physical memory, such
+   as vmalloc() memory. */
+static uintptr_t
+kernel_vtop (const void *vaddr)
+{
+  uint32_t pde = init_page_dir[pd_no (vaddr)];
+  uint32_t pte;
+
+  ASSERT (is_kernel_vaddr (vaddr));
+  ASSERT (pde & PTE_P);
+  pte = pde_get_pt (pde)[pt_no (vaddr)];
+  ASSERT (pte & PTE_P);
+  return (pte & PTE_ADDR) | pg_ofs (vaddr);
+}
+
+/* Places REQ on D's request queue and notifies the device.  Waits
+   first if the queue is short of descriptors. */
+static void
+virtio_submit (void *d_, struct block_request *req)
+{
+  struct virtio_disk *d = d_;
+  const uint8_t *buffer = req->buffer;
+  size_t size = req->cnt * BLOCK_SECTOR_SIZE;
+  size_t need = DIV_ROUND_UP (pg_ofs (buffer) + size, PGSIZE) + 2;
+  uint16_t head, data, status;
+  struct slot *slot;
+
+  ASSERT (need <= d->queue_size);
+
+  lock_acquire (&d->lock);
+  while (d->free_cnt < (int) need)
+    cond_wait (&d->desc_free, &d->lock);
+
+  block_start (d->block, req);
+  head = alloc_desc (d);
+
+  slot = &d->slots[head];
+  slot->header.type = req->write ? TYPE_OUT : TYPE_IN;
+  slot->header.reserved = 0;
+  slot->header.sector = req->sector;
+  slot->status = 0xff;
+  slot->req = req;
+
+  d->desc[head].addr = vtop (&slot->header);
+  d->desc[head].len = sizeof slot->header;
+  d->desc[head].flags = DESC_NEXT;
+
+  /* The device accesses the buffer by physical address.  Translate
+     it a page at a time, since it need not be physically
+     contiguous, and give each physically contiguous piece its own
+     descriptor. */
+  data = head;
+  while (size > 0)
+    {
+      uintptr_t addr = kernel_vtop (buffer);
+      size_t chunk = PGSIZE - pg_ofs (buffer);
+      if (chunk > size)
+        chunk = size;
+
+      if (data != head && d->desc[data].addr + d->desc[data].len == addr)
+        d->desc[data].len += chunk;
+      else
+        {
+          uint16_t next = alloc_desc (d);
+          d->desc[data].next = next;
+          data = next;
+          d->desc[data].addr = addr;
+          d->desc[data].len = chunk;
+          d->desc[data].flags = DESC_NEXT | (req->write ? 0 : DESC_WRITE);
+        }
+      buffer += chunk;
+      size -= chunk;
+    }
+
+  status = alloc_desc (d);
+  d->desc[data].next = status;
+  d->desc[status].addr = vtop (&slot->status);
+  d->desc[status].len = 1;
+  d->desc[status].flags = DESC_WRITE;
+
+  /* The device may look at the ring as soon as the index moves, so
+     the entry must be in place first. */
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+
+  lock_release (&d->lock);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  struct virtio_disk *d = d_;
+  block_read (d->block, sec_no, buffer);
+}
+
+/* Writes sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged writing the data. */
+static void
+virtio_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  struct virtio_disk *d = d_;
+  block_write (d->block, sec_no, buffer);
+}
+
+static struct block_operations virtio_operations =
+  {
+    virtio_read,
+    virtio_write,
+    NULL,
+    NULL,
+    virtio_submit
+  };
+
+/* Takes completed requests off disk D's used ring and calls their
+   callbacks, each time the interrupt handler signals. */
+static void
+completion_thread (void *d_)
+{
+  struct virtio_disk *d = d_;
+  struct list completed;
+
+  list_init (&completed);
+  for (;;)
+    {
+      sema_down (&d->completion_wait);
+
+      lock_acquire (&d->lock);
+      barrier ();
+      while (d->last_used != d->used->idx)
+        {
+          struct vring_used_elem *e;
+          struct slot *slot;
+
+          barrier ();
+          e = &d->used->ring[d->last_used % d->queue_size];
+          slot = &d->slots[e->id];
+          if (slot->status != 0)
+            PANIC ("%s: error %d on sector %"PRIu64, d->name,
+                   slot->status, slot->header.sector);
+          list_push_back (&completed, &slot->req->elem);
+          free_chain (d, e->id);
+          d->last_used++;
+          barrier ();
+        }
+      cond_broadcast (&d->desc_free, &d->lock);
+      lock_release (&d->lock);
+
+      while (!list_empty (&completed))
+        {
+          struct block_request *req
+            = list_entry (list_pop_front (&completed),
+                          struct block_request, elem);
+          block_complete (d->block, req);
+        }
+    }
+}
+
+/* Virtio interrupt handler.  Reading the interrupt status
+   acknowledges the interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct virtio_disk *d;
+
+  for (d = disks; d < disks + disk_cnt; d++)
+    if (f->vec_no == d->irq
+        && (inb (d->io_base + REG_ISR) & ISR_QUEUE) != 0)
+      sema_up (&d->completion_wait);
+}
@@ -0,0 +1,74 @@
+/* iostat.c
+
+   Prints I/O statistics for the block devices named on the
+   command line, e.g. "iostat hda hdb1". */
+
+#include <blkstat.h>
+#include <stdio.h>
+#include <syscall.h>
+
+/* Prints CYCLES in microseconds, given the cycle counter rate
+   CYCLES_PER_MS, or in cycles if the rate is unknown. */
+static void
+print_cycles (uint64_t cycles, uint64_t cycles_per_ms)
+{
+  if (cycles_per_ms != 0)
+    printf ("%llu us", cycles * 1000 / cycles_per_ms);
+  else
+    printf ("%llu cycles", cycles);
+}
+
+/* Prints the nonempty buckets of latency histogram HIST. */
+static void
+print_histogram (const char *name, const uint64_t hist[BLKSTAT_BUCKETS],
+                 uint64_t cycles_per_ms)
+{
+  int i;
+
+  printf ("  %s:\n", name);
+  for (i = 0; i < BLKSTAT_BUCKETS; i++)
+    if (hist[i] != 0)
+      {
+        int bit = BLKSTAT_SHIFT + (i < BLKSTAT_BUCKETS - 1 ? i : i - 1);
+        printf (i < BLKSTAT_BUCKETS - 1 ? "    < " : "    >= ");
+        print_cycles ((uint64_t) 1 << bit, cycles_per_ms);
+        printf (": %llu\n", hist[i]);
+      }
+}
+
+int
+main (int argc, char *argv[])
+{
+  bool success = true;
+  int i;
+
+  for (i = 1; i < argc; i++)
+    {
+      struct blkstat st;
+
+      if (!blkstat (argv[i], &st))
+        {
+          printf ("%s: no such block device\n", argv[i]);
+          success = false;
+          continue;
+        }
+
+      printf ("%s: %llu sectors read, %llu written, %llu bytes\n", argv[i],
+              st.read_cnt, st.write_cnt,
+              (st.read_cnt + st.write_cnt) * 512);
+      printf ("  %llu requests, %llu sequential, %u in flight (max %u)\n",
+              st.requests, st.sequential, st.in_flight, st.max_in_flight);
+      if (st.completed == 0)
+        continue;
+
+      printf ("  %llu carried out, avg depth %llu, avg queue wait ",
+              st.completed, st.depth_sum / st.completed);
+      print_cycles (st.queue_cycles / st.completed, st.cycles_per_ms);
+      printf (", avg service ");
+      print_cycles (st.service_cycles / st.completed, st.cycles_per_ms);
+      printf ("\n");
+      print_histogram ("queue wait", st.queue_hist, st.cycles_per_ms);
+      print_histogram ("service", st.service_hist, st.cycles_per_ms);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -9,6 +9,7 @@
    each file is also printed.  This won't work until project 4. */
 
 #include <syscall.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -24,38 +25,48 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      char buffer[1024];
+      int size;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
+      /* Fetch entries in batches rather than one readdir() per name. */
+      while ((size = getdents (dir_fd, buffer, sizeof buffer)) > 0)
         {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
+          int ofs;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          for (ofs = 0; ofs < size; )
+            {
+              struct dirent *d = (struct dirent *) (buffer + ofs);
 
-              printf (": ");
-              if (entry_fd != -1)
+              printf ("%s", d->d_name);
+              if (verbose)
                 {
-                  if (isdir (entry_fd))
+                  printf (": ");
+                  if (d->d_type == DT_DIR)
                     printf ("directory");
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    {
+                      char full_name[128];
+                      int entry_fd;
+
+                      snprintf (full_name, sizeof full_name, "%s/%s",
+                                dir, d->d_name);
+                      entry_fd = open (full_name);
+                      if (entry_fd != -1)
+                        printf ("%d-byte file", filesize (entry_fd));
+                      else
+                        printf ("open failed");
+                      close (entry_fd);
+                    }
+                  printf (", inumber %d", d->d_ino);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
+              ofs += d->d_reclen;
             }
-          printf ("\n");
         }
     }
   else 
@@ -1,18 +1,27 @@
 /* rm.c
 
-   Removes files specified on command line. */
+   Removes files specified on command line.  With -r, also removes
+   directories and everything beneath them. */
 
 #include <stdio.h>
+#include <string.h>
 #include <syscall.h>
 
 int
 main (int argc, char *argv[]) 
 {
   bool success = true;
-  int i;
+  bool recursive = false;
+  int i = 1;
+
+  if (argc > 1 && !strcmp (argv[1], "-r"))
+    {
+      recursive = true;
+      i++;
+    }
   
-  for (i = 1; i < argc; i++)
-    if (!remove (argv[i])) 
+  for (; i < argc; i++)
+    if (!(recursive ? rmtree (argv[i]) : remove (argv[i])))
       {
         printf ("%s: remove failed\n", argv[i]);
         success = false; 
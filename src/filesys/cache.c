@@ -1,16 +1,66 @@
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "devices/timer.h"
 
+/* Staging buffer for the runs of sectors read by the readahead
+   thread.  Cache entries are not contiguous in memory, so a run
+   is read here as a single request and then copied out.  Slot I
+   of readahead_entries is the cache entry claimed for the sector
+   read into slot I of the buffer. */
+static char readahead_buffer[READAHEAD_SIZE][BLOCK_SECTOR_SIZE];
+static int readahead_entries[READAHEAD_SIZE];
+static struct block_request readahead_requests[READAHEAD_SIZE];
+static struct semaphore readahead_sema; /* Upped per completed read. */
+
+/* Sectors read at a time by cache_read_multiple(), which fill its
+   page-sized bounce buffer. */
+#define BOUNCE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct lock flush_lock;      /* Serializes cache flushes. */
+
+/* Writes submitted by cache_flush() that have not completed. */
+static int flush_pending;
+static struct lock flush_pending_lock;
+static struct condition flush_idle; /* Signaled when FLUSH_PENDING
+                                       drops to 0. */
+
+/* A dirty cache entry, as seen by cache_flush() before sorting. */
+struct flush_slot
+  {
+    int sector_idx;                 /* Sector the entry held. */
+    int index;                      /* Cache index. */
+  };
+
+/* An asynchronous write of a run of sectors by cache_flush().  It
+   carries its own copy of the data, so the cache entries are free
+   to change while the write is in flight.  The block layer keeps
+   any later read of these sectors behind the write. */
+struct flush_request
+  {
+    struct block_request req;       /* Request to the block layer. */
+    char data[];                    /* The sectors to write. */
+  };
+
 /* Function prototypes. */
+static int cache_find (block_sector_t sector_idx);
 static int cache_lookup (block_sector_t sector_idx);
 static void cache_writeback_if_dirty (int);
 static int cache_evict (block_sector_t);
+static int cache_fetch_run (block_sector_t, int, int, int);
+static void cache_writeback (void);
+static void flush_done (struct block_request *);
+static void readahead_done (struct block_request *);
+static void read_sectors_done (struct block_request *);
+static int compare_slots (const void *, const void *);
+static int compare_sectors (const void *, const void *);
 void periodic_write_behind (void *);
 void read_ahead (void *);
 
@@ -32,6 +82,11 @@ cache_init (void)
     }
 
   lock_init (&eviction_lookup_lock);
+  lock_init (&flush_lock);
+  lock_init (&flush_pending_lock);
+  cond_init (&flush_idle);
+  flush_pending = 0;
+  sema_init (&readahead_sema, 0);
   lock_init (&readahead_lock);
   cond_init (&readahead_cond);
 
@@ -57,43 +112,163 @@ periodic_write_behind (void *aux UNUSED)
   while (1)
     {
       timer_msleep (WRITE_BEHIND_WAIT);
-      cache_flush();
+      cache_writeback ();
     }
 }
 
 /* One thread is in charge of reading ahead by one block from the disk
    after the intended block was returned.  The thread will wait to
    be awoken by the original file reader so that it does not busy
-   wait in the background. */
+   wait in the background.  Once awoken, it takes every queued
+   request at once and submits a read for each run of consecutive
+   missing sectors without waiting in between, so the block layer
+   can order and merge them, and then waits for all of them. */
 void
 read_ahead (void *aux UNUSED)
 {
+  block_sector_t sectors[READAHEAD_SIZE];
   int ra_index = 0;
-  int next_sector;
 
   /* Thread CANNOT terminate, so it is wrapped in an infinite while loop. */
   while (1)
     {
+      int cnt = 0;
+      int req_cnt = 0;
+      int slot = 0;
+      int i, j, run;
+
       lock_acquire (&readahead_lock);
-      ra_index = ra_index % READAHEAD_SIZE;
-      while (ra_index == next_readahead_entry)
+      while (ra_index == next_readahead_entry % READAHEAD_SIZE)
         cond_wait (&readahead_cond, &readahead_lock);
-      
-      /* If the readahead thread falls behind too far, force it to catch
-         up. */
-      if (ra_index + READAHEAD_SIZE < next_readahead_entry)
-        ra_index = next_readahead_entry - READAHEAD_CATCHUP;
 
-      next_sector = readahead_list[ra_index];
+      while (ra_index != next_readahead_entry % READAHEAD_SIZE)
+        {
+          sectors[cnt++] = readahead_list[ra_index];
+          ra_index = (ra_index + 1) % READAHEAD_SIZE;
+        }
       lock_release (&readahead_lock);
-      
-      /* If the block is not already in the cache, fetch it. */
-      int ra_index = cache_lookup ((block_sector_t) next_sector);
-      ASSERT (lock_held_by_current_thread 
-        (&cache_table[ra_index].entry_lock));
-      lock_release (&cache_table[ra_index].entry_lock);
-      ra_index++;
+
+      /* Sort and drop duplicates, then fetch each run. */
+      qsort (sectors, cnt, sizeof *sectors, compare_sectors);
+      for (i = j = 0; i < cnt; i++)
+        if (j == 0 || sectors[i] != sectors[j - 1])
+          sectors[j++] = sectors[i];
+      cnt = j;
+
+      for (i = 0; i < cnt; i += run)
+        {
+          for (run = 1; i + run < cnt; run++)
+            if (sectors[i + run] != sectors[i + run - 1] + 1)
+              break;
+          req_cnt += cache_fetch_run (sectors[i], run, slot, req_cnt);
+          slot += run;
+        }
+
+      for (i = 0; i < req_cnt; i++)
+        sema_down (&readahead_sema);
+
+      /* Fill in the claimed entries and let lookups at them. */
+      for (i = 0; i < req_cnt; i++)
+        {
+          struct block_request *req = &readahead_requests[i];
+          int *claimed = req->aux;
+          for (j = 0; j < (int) req->cnt; j++)
+            {
+              struct cache_entry *e = &cache_table[claimed[j]];
+              memcpy (e->data, (char *) req->buffer + j * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE);
+              lock_acquire (&eviction_lookup_lock);
+              if (e->next_sector_idx == (int) (req->sector + j))
+                e->next_sector_idx = -1;
+              lock_release (&eviction_lookup_lock);
+              lock_release (&e->entry_lock);
+            }
+        }
+    }
+}
+
+/* Claims cache entries for those of the CNT sectors starting at
+   FIRST that are not cached yet, and submits a read for each run
+   of them into readahead_buffer from slot SLOT on, using
+   readahead_requests from index REQ_IDX on.  Returns the number
+   of reads submitted.
+
+   cache_evict() returns holding each claimed entry's lock, which
+   keeps lookups of these sectors waiting until read_ahead() has
+   copied the data in. */
+static int
+cache_fetch_run (block_sector_t first, int cnt, int slot, int req_idx)
+{
+  int *entries = readahead_entries + slot;
+  int submitted = 0;
+  int i, run;
+
+  for (i = 0; i < cnt; i += run)
+    {
+      struct block_request *req;
+
+      for (run = 0; i + run < cnt; run++)
+        {
+          int e;
+
+          lock_acquire (&eviction_lookup_lock);
+          if (cache_find (first + i + run) != -1)
+            {
+              lock_release (&eviction_lookup_lock);
+              break;
+            }
+          e = cache_evict (first + i + run);
+          entries[i + run] = e;
+
+          /* Keep the entry marked as in transition until its data
+             arrives, so that the clock does not pick it again for
+             the next sector of this run. */
+          lock_acquire (&eviction_lookup_lock);
+          if (cache_table[e].next_sector_idx == -1)
+            cache_table[e].next_sector_idx = first + i + run;
+          lock_release (&eviction_lookup_lock);
+        }
+
+      if (run == 0)
+        {
+          run = 1;
+          continue;
+        }
+
+      req = &readahead_requests[req_idx + submitted++];
+      req->sector = first + i;
+      req->cnt = run;
+      req->buffer = readahead_buffer[slot + i];
+      req->write = false;
+      req->done = readahead_done;
+      req->aux = entries + i;
+      block_submit (fs_device, req);
     }
+  return submitted;
+}
+
+/* Completion callback for the reads of cache_fetch_run(). */
+static void
+readahead_done (struct block_request *req UNUSED)
+{
+  sema_up (&readahead_sema);
+}
+
+/* Returns the cache index of the entry holding or about to hold
+   SECTOR_IDX, or -1 if there is none.  The caller must hold
+   eviction_lookup_lock. */
+static int
+cache_find (block_sector_t sector_idx)
+{
+  int sector = -1;
+  int i = 0;
+
+  ASSERT (lock_held_by_current_thread (&eviction_lookup_lock));
+  for (; i < CACHE_SIZE; i++)
+    if (cache_table[i].sector_idx == (int) sector_idx ||
+        cache_table[i].next_sector_idx == (int) sector_idx)
+        sector = i;
+  return sector;
 }
 
 /* Look up an entry corresponding to the inputted sector index.
@@ -108,12 +283,7 @@ cache_lookup (block_sector_t sector_idx)
       /* Look for the entry in the cache.  Set sector to be the cache index
          if we find the block in cache or if the next block is the one we
          are looking for. */
-      int sector = -1;
-      int i = 0;
-      for (; i < CACHE_SIZE; i++)
-        if (cache_table[i].sector_idx == (int) sector_idx ||
-            cache_table[i].next_sector_idx == (int) sector_idx)
-            sector = i;
+      int sector = cache_find (sector_idx);
       
       /* Could not find the block in the cache.  Proceed to eviction.
          Note that by the time cache_evict returns, the process will
@@ -213,6 +383,149 @@ cache_write (block_sector_t sector_idx, void *buffer, int chunk_size,
   lock_release (&cache_table[index].entry_lock);
 }
 
+/* Reads CNT whole sectors starting at SECTOR_IDX into BUFFER.
+   Sectors that are cached are copied out of the cache.  Each run
+   of sectors that are not, up to a page at a time, is read from
+   disk with a single request, bypassing the cache so that a large
+   sequential read, such as loading an executable, does not flush
+   it.
+
+   BUFFER may be a user address, which the device's I/O thread
+   cannot reach, so runs are read into a kernel bounce page and
+   copied out from there.  A sector that was cached by a writer
+   while its run was being read is copied from the cache instead,
+   so the read never returns data older than the cache's. */
+void
+cache_read_multiple (block_sector_t sector_idx, void *buffer_, int cnt)
+{
+  char *buffer = buffer_;
+  char *bounce = NULL;
+  int i, j, run;
+
+  for (i = 0; i < cnt; i += run)
+    {
+      lock_acquire (&eviction_lookup_lock);
+      for (run = 0; i + run < cnt && run < BOUNCE_SECTORS; run++)
+        if (cache_find (sector_idx + i + run) != -1)
+          break;
+      lock_release (&eviction_lookup_lock);
+
+      if (run > 0 && bounce == NULL)
+        bounce = palloc_get_page (0);
+      if (run == 0 || bounce == NULL)
+        {
+          cache_read (sector_idx + i, buffer + i * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE, 0);
+          run = 1;
+          continue;
+        }
+
+      block_read_multiple (fs_device, sector_idx + i, run, bounce);
+      for (j = 0; j < run; j++)
+        {
+          block_sector_t sector = sector_idx + i + j;
+          char *dst = buffer + (i + j) * BLOCK_SECTOR_SIZE;
+          bool cached;
+
+          lock_acquire (&eviction_lookup_lock);
+          cached = cache_find (sector) != -1;
+          lock_release (&eviction_lookup_lock);
+          if (cached)
+            cache_read (sector, dst, BLOCK_SECTOR_SIZE, 0);
+          else
+            memcpy (dst, bounce + j * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+        }
+    }
+  palloc_free_page (bounce);
+}
+
+/* Reads the CNT sectors SECTORS[I] into the sector-sized buffers
+   BUFFERS[I].  Sectors that are cached are copied out of the
+   cache.  The rest are read from disk, bypassing the cache, with
+   every request submitted before waiting for any of them, so
+   that the disk sees the whole set at once; consecutive sectors
+   whose buffers are adjacent share a request.  The buffers must
+   be in the kernel's direct map, e.g. in frames, so that the
+   device can reach them.  As in cache_read_multiple(), a sector
+   cached by a writer meanwhile is copied from the cache. */
+void
+cache_read_sectors (const block_sector_t sectors[], void *buffers[],
+                    size_t cnt)
+{
+  struct block_request *reqs;
+  bool *uncached;
+  struct semaphore done;
+  size_t submitted = 0;
+  size_t i, j;
+
+  reqs = malloc (cnt * sizeof *reqs);
+  uncached = malloc (cnt * sizeof *uncached);
+  if (reqs == NULL || uncached == NULL)
+    {
+      free (reqs);
+      free (uncached);
+      for (i = 0; i < cnt; i++)
+        cache_read (sectors[i], buffers[i], BLOCK_SECTOR_SIZE, 0);
+      return;
+    }
+
+  lock_acquire (&eviction_lookup_lock);
+  for (i = 0; i < cnt; i++)
+    uncached[i] = cache_find (sectors[i]) == -1;
+  lock_release (&eviction_lookup_lock);
+
+  sema_init (&done, 0);
+  for (i = 0; i < cnt; i = j)
+    {
+      struct block_request *req;
+
+      if (!uncached[i])
+        {
+          cache_read (sectors[i], buffers[i], BLOCK_SECTOR_SIZE, 0);
+          j = i + 1;
+          continue;
+        }
+
+      for (j = i + 1; j < cnt && uncached[j]; j++)
+        if (sectors[j] != sectors[j - 1] + 1
+            || buffers[j] != (char *) buffers[j - 1] + BLOCK_SECTOR_SIZE)
+          break;
+
+      req = &reqs[submitted++];
+      req->sector = sectors[i];
+      req->cnt = j - i;
+      req->buffer = buffers[i];
+      req->write = false;
+      req->done = read_sectors_done;
+      req->aux = &done;
+      block_submit (fs_device, req);
+    }
+  for (i = 0; i < submitted; i++)
+    sema_down (&done);
+
+  for (i = 0; i < cnt; i++)
+    if (uncached[i])
+      {
+        bool cached;
+
+        lock_acquire (&eviction_lookup_lock);
+        cached = cache_find (sectors[i]) != -1;
+        lock_release (&eviction_lookup_lock);
+        if (cached)
+          cache_read (sectors[i], buffers[i], BLOCK_SECTOR_SIZE, 0);
+      }
+
+  free (reqs);
+  free (uncached);
+}
+
+/* Completion callback for the reads of cache_read_sectors(). */
+static void
+read_sectors_done (struct block_request *req)
+{
+  sema_up (req->aux);
+}
+
 /* Writes the cache block back to disk if the cache block is dirty. Also
    clears the dirty bit associated with that cache entry. */
 static void
@@ -226,16 +539,137 @@ cache_writeback_if_dirty (int index)
     }
 }
 
-/* Iterate over all cache entries and call cache_writeback_if_dirty,
-   which will check if the block is dirty and should be written back. */
+/* Writes every dirty cache block back to disk and waits until
+   the writes are complete. */
 void
 cache_flush (void)
 {
-  int i = 0;
-  for (; i < CACHE_SIZE; i++)
+  cache_writeback ();
+
+  lock_acquire (&flush_pending_lock);
+  while (flush_pending > 0)
+    cond_wait (&flush_idle, &flush_pending_lock);
+  lock_release (&flush_pending_lock);
+}
+
+/* Starts writing every dirty cache block back to disk, without
+   waiting for the writes to complete.  Dirty blocks are visited
+   in sector order, and each run of consecutive dirty sectors is
+   copied out and submitted as a single disk request.  The block
+   layer keeps any later read or write of these sectors behind
+   the request, so an entry may be reused as soon as its data has
+   been copied. */
+static void
+cache_writeback (void)
+{
+  struct flush_slot order[CACHE_SIZE];
+  int cnt = 0;
+  int i, j, run;
+
+  lock_acquire (&flush_lock);
+
+  /* The sector numbers read here only decide the order; each
+     entry is rechecked under its lock. */
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache_table[i].dirty)
+      {
+        order[cnt].sector_idx = cache_table[i].sector_idx;
+        order[cnt].index = i;
+        cnt++;
+      }
+  qsort (order, cnt, sizeof *order, compare_slots);
+
+  for (i = 0; i < cnt; i += run)
     {
-      lock_acquire (&cache_table[i].entry_lock);
-      cache_writeback_if_dirty (i);
-      lock_release (&cache_table[i].entry_lock);
+      int first = order[i].index;
+      struct flush_request *f;
+      block_sector_t start;
+
+      lock_acquire (&cache_table[first].entry_lock);
+      if (!cache_table[first].dirty)
+        {
+          lock_release (&cache_table[first].entry_lock);
+          run = 1;
+          continue;
+        }
+      start = cache_table[first].sector_idx;
+
+      /* Extend the run with entries for the following sectors.
+         Never wait for a lock while holding others. */
+      for (run = 1; i + run < cnt; run++)
+        {
+          struct cache_entry *e = &cache_table[order[i + run].index];
+          if (!lock_try_acquire (&e->entry_lock))
+            break;
+          if (!e->dirty || e->sector_idx != (int) (start + run))
+            {
+              lock_release (&e->entry_lock);
+              break;
+            }
+        }
+
+      f = malloc (sizeof *f + run * BLOCK_SECTOR_SIZE);
+      if (f != NULL)
+        {
+          for (j = 0; j < run; j++)
+            memcpy (f->data + j * BLOCK_SECTOR_SIZE,
+                    cache_table[order[i + j].index].data, BLOCK_SECTOR_SIZE);
+          f->req.sector = start;
+          f->req.cnt = run;
+          f->req.buffer = f->data;
+          f->req.write = true;
+          f->req.done = flush_done;
+          f->req.aux = f;
+
+          lock_acquire (&flush_pending_lock);
+          flush_pending++;
+          lock_release (&flush_pending_lock);
+          block_submit (fs_device, &f->req);
+        }
+      else
+        {
+          /* Out of memory: write the entries one at a time. */
+          for (j = 0; j < run; j++)
+            block_write (fs_device, start + j,
+                         cache_table[order[i + j].index].data);
+        }
+
+      for (j = 0; j < run; j++)
+        {
+          cache_table[order[i + j].index].dirty = false;
+          lock_release (&cache_table[order[i + j].index].entry_lock);
+        }
     }
+
+  lock_release (&flush_lock);
+}
+
+/* Completion callback for the writes of cache_writeback(). */
+static void
+flush_done (struct block_request *req)
+{
+  free (req->aux);
+
+  lock_acquire (&flush_pending_lock);
+  if (--flush_pending == 0)
+    cond_broadcast (&flush_idle, &flush_pending_lock);
+  lock_release (&flush_pending_lock);
+}
+
+/* Orders flush slots by sector. */
+static int
+compare_slots (const void *a_, const void *b_)
+{
+  int a = ((const struct flush_slot *) a_)->sector_idx;
+  int b = ((const struct flush_slot *) b_)->sector_idx;
+  return a < b ? -1 : a > b;
+}
+
+/* Orders sector numbers. */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  block_sector_t a = *(const block_sector_t *) a_;
+  block_sector_t b = *(const block_sector_t *) b_;
+  return a < b ? -1 : a > b;
 }
@@ -15,10 +15,6 @@
 
 /* Size of the readahead queue. */
 #define READAHEAD_SIZE (CACHE_SIZE / 2)
-
-/* How far ahead the readahead thread should jump in its indexing so that
-   it does not fall inefficiently far behind. */
-#define READAHEAD_CATCHUP (READAHEAD_SIZE / 4)
                                                
 /* Entry into the cache.  Holds metadata about the entry in addition to
    the data block. */
@@ -46,6 +42,8 @@ struct condition readahead_cond;  /* Readahead thread wakeup condition. */
 void cache_init (void);
 void cache_read (block_sector_t, void *, int, int);
 void cache_write (block_sector_t, void *, int, int);
+void cache_read_multiple (block_sector_t, void *, int);
+void cache_read_sectors (const block_sector_t[], void *[], size_t);
 void cache_flush (void);
 
 #endif /* filesys/cache.h */
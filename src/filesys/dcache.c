@@ -0,0 +1,208 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Kernel name cache.  Maps a (parent directory sector, name) pair
+   to the sector of the child's inode, so that path resolution can
+   skip reading directory blocks for names it has already seen.
+   Names known to be absent are cached as well, with
+   DCACHE_NEGATIVE as their sector.
+
+   Entries are invalidated by dir_add() and dir_remove().  A
+   lookup that misses and then reads the directory from disk can
+   race with a concurrent add or remove, so every invalidation
+   bumps a generation counter: a result is only inserted if no
+   invalidation happened since the caller's dcache_lookup(). */
+
+/* A cached name. */
+struct dcache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dcache_hash. */
+    struct list_elem lru_elem;          /* Element in dcache_lru. */
+    bool in_use;                        /* Is this entry in the hash? */
+    block_sector_t parent;              /* Sector of parent directory. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t child;               /* Child sector or
+                                           DCACHE_NEGATIVE. */
+    bool is_file;                       /* Is the child a file? */
+  };
+
+static struct dcache_entry dcache_entries[DCACHE_SIZE]; /* Entry pool. */
+static struct hash dcache_hash;     /* Entries by (parent, name). */
+static struct list dcache_lru;      /* All entries, most recent first. */
+static struct lock dcache_lock;     /* Protects all of the above. */
+static unsigned dcache_generation;  /* Bumped on every invalidation. */
+
+static unsigned dcache_hash_func (const struct hash_elem *, void *);
+static bool dcache_less_func (const struct hash_elem *,
+                              const struct hash_elem *, void *);
+static struct dcache_entry *dcache_find (block_sector_t, const char *);
+static void dcache_drop (struct dcache_entry *);
+
+/* Initializes the name cache.  Every entry starts out free at the
+   tail of the LRU list. */
+void
+dcache_init (void)
+{
+  int i = 0;
+
+  hash_init (&dcache_hash, dcache_hash_func, dcache_less_func, NULL);
+  list_init (&dcache_lru);
+  lock_init (&dcache_lock);
+  dcache_generation = 0;
+
+  for (; i < DCACHE_SIZE; i++)
+    {
+      dcache_entries[i].in_use = false;
+      list_push_back (&dcache_lru, &dcache_entries[i].lru_elem);
+    }
+}
+
+/* Looks up NAME in the directory at sector PARENT.  Returns true
+   on a hit and stores the cached child sector, possibly
+   DCACHE_NEGATIVE, into *CHILD and whether it is a file into
+   *IS_FILE.  In either case stores the
+   current generation into *GENERATION for a later
+   dcache_insert(). */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *child, bool *is_file, unsigned *generation)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  *generation = dcache_generation;
+  e = dcache_find (parent, name);
+  if (e != NULL)
+    {
+      *child = e->child;
+      *is_file = e->is_file;
+      list_remove (&e->lru_elem);
+      list_push_front (&dcache_lru, &e->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return e != NULL;
+}
+
+/* Records that NAME in the directory at sector PARENT refers to
+   sector CHILD, a file if IS_FILE is true and a directory
+   otherwise, or does not exist if CHILD is DCACHE_NEGATIVE.
+   Does nothing if the cache was invalidated since the
+   dcache_lookup() that returned GENERATION, since the caller's
+   result may then be stale.  Reuses the least recently used
+   entry. */
+void
+dcache_insert (block_sector_t parent, const char *name, block_sector_t child,
+               bool is_file, unsigned generation)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  if (generation == dcache_generation && dcache_find (parent, name) == NULL)
+    {
+      e = list_entry (list_back (&dcache_lru), struct dcache_entry, lru_elem);
+      dcache_drop (e);
+
+      e->parent = parent;
+      strlcpy (e->name, name, sizeof e->name);
+      e->child = child;
+      e->is_file = is_file;
+      e->in_use = true;
+      hash_insert (&dcache_hash, &e->hash_elem);
+      list_remove (&e->lru_elem);
+      list_push_front (&dcache_lru, &e->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets NAME in the directory at sector PARENT.  Called whenever
+   that name is added or removed. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  dcache_generation++;
+  e = dcache_find (parent, name);
+  if (e != NULL)
+    dcache_drop (e);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name in the directory at sector PARENT.  Called
+   when that directory is removed, since its sector may be reused
+   by an unrelated inode. */
+void
+dcache_invalidate_dir (block_sector_t parent)
+{
+  int i = 0;
+
+  lock_acquire (&dcache_lock);
+  dcache_generation++;
+  for (; i < DCACHE_SIZE; i++)
+    if (dcache_entries[i].in_use && dcache_entries[i].parent == parent)
+      dcache_drop (&dcache_entries[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the in-use entry for (PARENT, NAME), or a null pointer.
+   The caller must hold dcache_lock. */
+static struct dcache_entry *
+dcache_find (block_sector_t parent, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache_hash, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Removes E from the hash, leaving it free at the tail of the LRU
+   list.  The caller must hold dcache_lock. */
+static void
+dcache_drop (struct dcache_entry *e)
+{
+  if (e->in_use)
+    {
+      hash_delete (&dcache_hash, &e->hash_elem);
+      e->in_use = false;
+      list_remove (&e->lru_elem);
+      list_push_back (&dcache_lru, &e->lru_elem);
+    }
+}
+
+/* Hashes an entry's parent sector and name. */
+static unsigned
+dcache_hash_func (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->parent);
+}
+
+/* Orders entries by parent sector, then by name. */
+static bool
+dcache_less_func (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,22 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of (directory, name) pairs the name cache remembers. */
+#define DCACHE_SIZE 256
+
+/* Sector recorded for a name that is known not to exist. */
+#define DCACHE_NEGATIVE ((block_sector_t) -1)
+
+/* Prototypes for dcache.c functions. */
+void dcache_init (void);
+bool dcache_lookup (block_sector_t, const char *, block_sector_t *, bool *,
+                    unsigned *);
+void dcache_insert (block_sector_t, const char *, block_sector_t, bool,
+                    unsigned);
+void dcache_invalidate (block_sector_t, const char *);
+void dcache_invalidate_dir (block_sector_t);
+
+#endif /* filesys/dcache.h */
@@ -1,10 +1,15 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 
 /* A directory. */
@@ -14,23 +19,125 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
+/* A single directory entry, as handed around in memory.  On disk,
+   entries are stored as variable-length struct dir_record. */
 struct dir_entry
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
+    bool is_file;                       /* File or directory? */
+  };
+
+/* On-disk directory entry.  Records are packed into the record
+   area of a sector and never span a sector boundary.  REC_LEN
+   links each record to the next one in the same area, so the last
+   record also owns the area's unused tail.  A record with a
+   NAME_LEN of 0 is free. */
+struct dir_record
+  {
+    block_sector_t inode_sector;        /* Sector number of header. */
+    uint16_t rec_len;                   /* Bytes to the next record. */
+    uint8_t name_len;                   /* Length of NAME, 0 if free. */
+    uint8_t type;                       /* DT_REG or DT_DIR. */
+    char name[];                        /* File name, not null terminated. */
+  };
+
+/* Bytes occupied by a record holding a NAME_LEN byte name. */
+#define DIR_RECORD_SIZE(NAME_LEN) \
+        ROUND_UP (sizeof (struct dir_record) + (NAME_LEN), 4)
+
+/* Number of sectors a directory may use in the linear layout.
+   Once a linear directory is full, it is converted to the hashed
+   layout so that lookups and inserts read a bounded number of
+   sectors instead of scanning every entry. */
+#define DIR_LINEAR_SECTORS 2
+
+/* Identifies the index header of a hashed directory. */
+#define DIR_INDEX_MAGIC 0x44494458
+
+/* Maximum depth of the hashed directory's bucket table.  Buckets
+   at this depth no longer split; they chain overflow buckets
+   instead. */
+#define DIR_MAX_DEPTH 7
+#define DIR_TABLE_SIZE (1 << DIR_MAX_DEPTH)
+
+/* Index header of a hashed directory, stored in the directory's
+   first sector.  The low GLOBAL_DEPTH bits of a name's hash
+   select a TABLE slot, which names the bucket holding the entry.
+   Bucket N lives in the directory's sector N. */
+struct dir_index
+  {
+    unsigned magic;                     /* DIR_INDEX_MAGIC. */
+    uint32_t global_depth;              /* Bits of hash used by TABLE. */
+    uint32_t bucket_cnt;                /* Buckets in use, including
+                                           overflow buckets. */
+    uint16_t table[DIR_TABLE_SIZE];     /* Hash slot to bucket. */
+  };
+
+/* Size of the record area of a bucket. */
+#define DIR_BUCKET_AREA (BLOCK_SECTOR_SIZE - 4)
+
+/* A bucket of a hashed directory.  Exactly one sector. */
+struct dir_bucket
+  {
+    uint16_t local_depth;               /* Bits of hash shared by entries. */
+    uint16_t next;                      /* Overflow bucket, 0 if none. */
+    uint8_t records[DIR_BUCKET_AREA];   /* Record area. */
+  };
+
+/* An inode gathered by dir_rmtree(). */
+struct subtree_node
+  {
+    struct inode *inode;                /* Open inode. */
+    bool is_file;                       /* File or directory? */
+  };
+
+/* The inodes of a subtree being removed by dir_rmtree(), held
+   open until the whole subtree has been gathered. */
+struct subtree
+  {
+    struct subtree_node *nodes;         /* Gathered inodes. */
+    size_t cnt;                         /* Number of NODES in use. */
+    size_t cap;                         /* Number of NODES allocated. */
   };
 
 bool dir_entry_is_file (struct dir_entry *);
 bool cleanup_dir (struct dir *);
+static bool scan (const struct dir *, const char *, struct dir_entry *,
+                  off_t *);
+static bool read_next_entry (const struct dir *, off_t *, struct dir_entry *,
+                             off_t *);
+static struct dir_record *record_at (void *, int);
+static void read_area (const struct dir *, off_t, void *, size_t);
+static void record_to_entry (const struct dir_record *, struct dir_entry *);
+static int area_find (void *, size_t, const char *);
+static bool linear_add (struct dir *, const struct dir_entry *);
+static off_t area_start (const struct dir *);
+static bool remove_record (struct dir *, off_t);
+static bool record_sectors (const struct dir *, off_t *, off_t *);
+static bool subtree_add (struct subtree *, const struct dir_entry *);
+static bool subtree_gather (struct subtree *, struct inode *);
+static bool index_lookup (const struct dir *, const char *,
+                          struct dir_entry *, off_t *);
+static bool index_add (struct dir *, const struct dir_entry *);
+static bool index_convert (struct dir *);
+
+/* Cache of 'struct dir's. */
+static struct kmem_cache *dir_cache;
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), NULL);
+}
 
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, (entry_cnt) * sizeof (struct dir_entry), 0);
+  return inode_create (sector, entry_cnt * DIR_RECORD_SIZE (NAME_MAX), 0);
 }
 
 /* Creates entries "." and ".." for a directory that is located in SECTOR. */
@@ -48,10 +155,7 @@ setup_dir (struct dir *parent, block_sector_t sector)
 bool
 dir_entry_is_file (struct dir_entry *e)
 {
-   struct inode *inode = inode_open (e->inode_sector);
-   bool is_file = inode_is_file (inode);
-   inode_close (inode);
-   return is_file;
+   return e->is_file;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -59,7 +163,7 @@ dir_entry_is_file (struct dir_entry *e)
 struct dir *
 dir_open (struct inode *inode)
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir = kmem_cache_alloc (dir_cache);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
@@ -69,7 +173,7 @@ dir_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL;
     }
 }
@@ -99,7 +203,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -114,29 +218,86 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Lookups that do not need the entry's offset are answered from
+   the name cache when possible.  No entry has an empty name. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp)
 {
+  block_sector_t parent, child;
+  unsigned generation;
   struct dir_entry e;
-  size_t ofs;
+  bool found, is_file;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (e.in_use && !strcmp (name, e.name))
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  if (*name == '\0')
+    return false;
 
-  return false;
+  if (ofsp != NULL)
+    return scan (dir, name, ep, ofsp);
+
+  parent = inode_get_inumber (dir->inode);
+  if (dcache_lookup (parent, name, &child, &is_file, &generation))
+    {
+      if (child == DCACHE_NEGATIVE)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = child;
+          strlcpy (ep->name, name, sizeof ep->name);
+          ep->is_file = is_file;
+        }
+      return true;
+    }
+
+  found = scan (dir, name, &e, NULL);
+  dcache_insert (parent, name, found ? e.inode_sector : DCACHE_NEGATIVE,
+                 found && e.is_file, generation);
+  if (found && ep != NULL)
+    *ep = e;
+  return found;
+}
+
+/* Reads DIR's entries to find NAME.  Behaves like lookup(), but
+   bypasses the name cache. */
+static bool
+scan (const struct dir *dir, const char *name,
+      struct dir_entry *ep, off_t *ofsp)
+{
+  uint8_t *area;
+  off_t sector, sector_cnt;
+  int ofs = -1;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  if (inode_is_indexed (dir->inode))
+    return index_lookup (dir, name, ep, ofsp);
+
+  area = malloc (BLOCK_SECTOR_SIZE);
+  if (area == NULL)
+    return false;
+
+  /* Search one whole sector of records at a time. */
+  sector_cnt = DIV_ROUND_UP (inode_length (dir->inode), BLOCK_SECTOR_SIZE);
+  for (sector = 0; sector < sector_cnt && ofs < 0; sector++)
+    {
+      read_area (dir, sector * BLOCK_SECTOR_SIZE, area, BLOCK_SECTOR_SIZE);
+      ofs = area_find (area, BLOCK_SECTOR_SIZE, name);
+      if (ofs >= 0)
+        {
+          if (ep != NULL)
+            record_to_entry (record_at (area, ofs), ep);
+          if (ofsp != NULL)
+            *ofsp = sector * BLOCK_SECTOR_SIZE + ofs;
+        }
+    }
+
+  free (area);
+  return ofs >= 0;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -177,7 +338,6 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
          bool is_file)
 {
   struct dir_entry e;
-  off_t ofs;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -191,27 +351,19 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
+  e.is_file = is_file;
+  if (inode_is_indexed (dir->inode))
+    success = index_add (dir, &e);
+  else
+    success = linear_add (dir, &e);
 
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
   /* Because setup_dir calls dir_add, we prevent an infinite loop by not
      setting up a directory that is already in the process of adding "." and
      ".." */
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
   if (success && !is_file && strcmp (name, ".") && strcmp (name, ".."))
     success = setup_dir (dir, inode_sector);
 
@@ -236,6 +388,7 @@ dir_remove (struct dir *dir, const char *name)
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
+  bool is_file;
   off_t ofs;
 
   ASSERT (dir != NULL);
@@ -250,7 +403,8 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  if (!dir_entry_is_file (&e) && strcmp (name, ".") && strcmp (name, ".."))
+  is_file = dir_entry_is_file (&e);
+  if (!is_file && strcmp (name, ".") && strcmp (name, ".."))
     {
       struct dir *child_dir = dir_open (inode);
       if (!dir_is_empty (child_dir))
@@ -260,9 +414,11 @@ dir_remove (struct dir *dir, const char *name)
         }
     }
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+  if (!remove_record (dir, ofs))
     goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (!is_file && strcmp (name, ".") && strcmp (name, ".."))
+    dcache_invalidate_dir (e.inode_sector);
 
   /* Remove inode. */
   inode_remove (inode);
@@ -281,6 +437,140 @@ dir_remove (struct dir *dir, const char *name)
     return success;
 }
 
+/* Removes NAME from DIR together with, if it is a directory, the
+   whole subtree beneath it.  The subtree is gathered first,
+   breadth first, reading each of its directories' sectors once.
+   Nothing is unlinked or marked removed until that has
+   succeeded, so a failure leaves the tree as it was.  Entries
+   inside the subtree are not erased one by one, since their
+   directories' blocks are freed along with them.
+   Returns true if successful, false if there is no entry for
+   NAME, NAME is "." or "..", a directory in the subtree is open
+   (for example, as a process's working directory), or memory or
+   disk errors occur. */
+bool
+dir_rmtree (struct dir *dir, const char *name)
+{
+  struct subtree tree = { NULL, 0, 0 };
+  struct dir_entry e;
+  bool success = false;
+  size_t i;
+  off_t ofs;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+  if (!lookup (dir, name, &e, &ofs))
+    return false;
+  if (e.is_file)
+    return dir_remove (dir, name);
+
+  /* TREE grows as its directories are read, so this visits every
+     directory in the subtree without recursing. */
+  if (!subtree_add (&tree, &e))
+    goto done;
+  for (i = 0; i < tree.cnt; i++)
+    if (!tree.nodes[i].is_file
+        && !subtree_gather (&tree, tree.nodes[i].inode))
+      goto done;
+
+  /* Unlink the subtree root from DIR, then remove every inode.
+     Their sectors are released when the last opener closes
+     them. */
+  if (!remove_record (dir, ofs))
+    goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  for (i = 0; i < tree.cnt; i++)
+    {
+      if (!tree.nodes[i].is_file)
+        dcache_invalidate_dir (inode_get_inumber (tree.nodes[i].inode));
+      inode_remove (tree.nodes[i].inode);
+    }
+  success = true;
+
+ done:
+  for (i = 0; i < tree.cnt; i++)
+    inode_close (tree.nodes[i].inode);
+  free (tree.nodes);
+  return success;
+}
+
+/* Opens the inode of entry *E and appends it to TREE. */
+static bool
+subtree_add (struct subtree *tree, const struct dir_entry *e)
+{
+  struct subtree_node *n;
+
+  if (tree->cnt == tree->cap)
+    {
+      size_t cap = tree->cap > 0 ? tree->cap * 2 : 16;
+      struct subtree_node *nodes = realloc (tree->nodes,
+                                            cap * sizeof *nodes);
+      if (nodes == NULL)
+        return false;
+      tree->nodes = nodes;
+      tree->cap = cap;
+    }
+
+  n = &tree->nodes[tree->cnt];
+  n->inode = inode_open (e->inode_sector);
+  if (n->inode == NULL)
+    return false;
+  n->is_file = e->is_file;
+  tree->cnt++;
+  return true;
+}
+
+/* Appends every entry of directory INODE other than "." and ".."
+   to TREE.  Each sector's record area is read once and walked in
+   memory.  Fails if anyone besides TREE has the directory open. */
+static bool
+subtree_gather (struct subtree *tree, struct inode *inode)
+{
+  struct dir *dir;
+  struct dir_record *r;
+  struct dir_entry e;
+  uint8_t *area;
+  off_t start, sector, first, end;
+  size_t size, ofs;
+  bool success;
+
+  if (inode_open_cnt (inode) > 1)
+    return false;
+
+  dir = dir_open (inode_reopen (inode));
+  area = malloc (BLOCK_SECTOR_SIZE);
+  success = (dir != NULL && area != NULL
+             && record_sectors (dir, &first, &end));
+  if (!success)
+    goto done;
+
+  start = area_start (dir);
+  size = BLOCK_SECTOR_SIZE - start;
+  for (sector = first; sector < end && success; sector++)
+    {
+      read_area (dir, sector * BLOCK_SECTOR_SIZE + start, area, size);
+      for (ofs = 0; ofs < size && success; ofs += r->rec_len)
+        {
+          r = record_at (area, ofs);
+          if (r->rec_len == 0)
+            break;
+          if (r->name_len == 0)
+            continue;
+          record_to_entry (r, &e);
+          if (strcmp (e.name, ".") && strcmp (e.name, ".."))
+            success = subtree_add (tree, &e);
+        }
+    }
+
+ done:
+  free (area);
+  dir_close (dir);
+  return success;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
@@ -289,10 +579,9 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+  while (read_next_entry (dir, &dir->pos, &e, NULL))
     {
-      dir->pos += sizeof e;
-      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      if (strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -302,6 +591,42 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   return false;
 }
 
+/* Reads as many of DIR's remaining entries as fit in the SIZE
+   bytes at BUFFER, packed as struct dirent records.  Like
+   dir_readdir(), skips "." and "..".  Returns the number of bytes
+   stored, 0 if the directory contains no more entries, or -1 if
+   SIZE is too small to hold even the next entry. */
+int
+dir_getdents (struct dir *dir, void *buffer, size_t size)
+{
+  uint8_t *records = buffer;
+  size_t used = 0;
+  struct dir_entry e;
+  off_t pos = dir->pos;
+
+  while (read_next_entry (dir, &pos, &e, NULL))
+    {
+      if (strcmp (e.name, ".") && strcmp (e.name, ".."))
+        {
+          size_t reclen = DIRENT_RECLEN (strlen (e.name));
+          struct dirent *d = (struct dirent *) (records + used);
+
+          /* Leave the entry for the next call if it does not fit. */
+          if (used + reclen > size)
+            return used > 0 ? (int) used : -1;
+
+          d->d_ino = e.inode_sector;
+          d->d_reclen = reclen;
+          d->d_type = e.is_file ? DT_REG : DT_DIR;
+          strlcpy (d->d_name, e.name, NAME_MAX + 1);
+          used += reclen;
+        }
+      dir->pos = pos;
+    }
+
+  return used;
+}
+
 /* Returns the directory struct given a starting directory and an absolute
    or relative path.  This will return a newly opened directory, closing any
    other directories it open while traversing the path.  This function always
@@ -373,9 +698,585 @@ dir_is_empty (struct dir *dir)
 
   /* If an entry is in use and it is not "." or "..", the directory
      is not free. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+  for (ofs = 0; read_next_entry (dir, &ofs, &e, NULL); )
+    if (strcmp (e.name, ".") && strcmp (e.name, ".."))
       return false;
   return true;
 }
+
+/* Returns the record at byte offset OFS of record area AREA. */
+static struct dir_record *
+record_at (void *area, int ofs)
+{
+  return (struct dir_record *) ((uint8_t *) area + ofs);
+}
+
+/* Formats the SIZE-byte record area AREA as a single free
+   record. */
+static void
+area_init (void *area, size_t size)
+{
+  struct dir_record *r = record_at (area, 0);
+
+  r->inode_sector = 0;
+  r->rec_len = size;
+  r->name_len = 0;
+  r->type = 0;
+}
+
+/* Reads the SIZE-byte record area at offset OFS of DIR into AREA.
+   Bytes past the end of the directory, and areas that were never
+   written, read as an empty area. */
+static void
+read_area (const struct dir *dir, off_t ofs, void *area, size_t size)
+{
+  off_t bytes = inode_read_at (dir->inode, area, size, ofs);
+
+  if (bytes < 0)
+    bytes = 0;
+  memset ((uint8_t *) area + bytes, 0, size - bytes);
+  if (record_at (area, 0)->rec_len == 0)
+    area_init (area, size);
+}
+
+/* Copies record R into *EP. */
+static void
+record_to_entry (const struct dir_record *r, struct dir_entry *ep)
+{
+  ep->inode_sector = r->inode_sector;
+  memcpy (ep->name, r->name, r->name_len);
+  ep->name[r->name_len] = '\0';
+  ep->is_file = r->type == DT_REG;
+}
+
+/* Returns the offset of the record for NAME in the SIZE-byte
+   record area AREA, or -1 if there is none.  Free records are
+   never matched, so NAME may even be empty. */
+static int
+area_find (void *area, size_t size, const char *name)
+{
+  size_t name_len = strlen (name);
+  struct dir_record *r;
+  size_t ofs;
+
+  for (ofs = 0; ofs < size; ofs += r->rec_len)
+    {
+      r = record_at (area, ofs);
+      if (r->rec_len == 0)
+        break;
+      if (r->name_len != 0 && r->name_len == name_len
+          && !memcmp (r->name, name, name_len))
+        return ofs;
+    }
+  return -1;
+}
+
+/* Stores *E as a record in the SIZE-byte record area AREA, either
+   in the free first record or in the unused tail of an existing
+   record.  Returns false if no record has enough room. */
+static bool
+area_insert (void *area, size_t size, const struct dir_entry *e)
+{
+  size_t name_len = strlen (e->name);
+  size_t need = DIR_RECORD_SIZE (name_len);
+  struct dir_record *r;
+  size_t ofs;
+
+  for (ofs = 0; ofs < size; ofs += r->rec_len)
+    {
+      size_t used;
+
+      r = record_at (area, ofs);
+      if (r->rec_len == 0)
+        break;
+      used = r->name_len != 0 ? DIR_RECORD_SIZE (r->name_len) : 0;
+      if (r->rec_len - used >= need)
+        {
+          /* Carve the new record out of R's tail. */
+          if (used > 0)
+            {
+              struct dir_record *tail = record_at (area, ofs + used);
+              tail->rec_len = r->rec_len - used;
+              r->rec_len = used;
+              r = tail;
+            }
+          r->inode_sector = e->inode_sector;
+          r->name_len = name_len;
+          r->type = e->is_file ? DT_REG : DT_DIR;
+          memcpy (r->name, e->name, name_len);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Frees the record at offset OFS of the SIZE-byte record area
+   AREA.  Its space is merged into the preceding record, or, for
+   the first record, the record is simply marked free. */
+static void
+area_remove (void *area, size_t size, size_t ofs)
+{
+  struct dir_record *r = record_at (area, ofs);
+  struct dir_record *prev;
+  size_t prev_ofs;
+
+  for (prev_ofs = 0; prev_ofs < ofs; prev_ofs += prev->rec_len)
+    {
+      prev = record_at (area, prev_ofs);
+      if (prev->rec_len == 0 || prev_ofs + prev->rec_len > size)
+        break;
+      if (prev_ofs + prev->rec_len == ofs)
+        {
+          prev->rec_len += r->rec_len;
+          return;
+        }
+    }
+  r->name_len = 0;
+}
+
+/* Returns the offset within a sector of DIR at which its record
+   area starts. */
+static off_t
+area_start (const struct dir *dir)
+{
+  return inode_is_indexed (dir->inode) ? offsetof (struct dir_bucket, records)
+                                       : 0;
+}
+
+/* Removes the record at byte offset OFS of DIR, as returned by
+   lookup(). */
+static bool
+remove_record (struct dir *dir, off_t ofs)
+{
+  off_t start = area_start (dir);
+  off_t sector_ofs = ROUND_DOWN (ofs, BLOCK_SECTOR_SIZE);
+  size_t size = BLOCK_SECTOR_SIZE - start;
+  uint8_t *area = malloc (size);
+  bool success;
+
+  if (area == NULL)
+    return false;
+  read_area (dir, sector_ofs + start, area, size);
+  area_remove (area, size, ofs - sector_ofs - start);
+  success = inode_write_at (dir->inode, area, size,
+                            sector_ofs + start) == (off_t) size;
+  free (area);
+  return success;
+}
+
+/* Sets *FIRSTP and *ENDP to the bounds of the range of DIR's
+   sectors that hold record areas: every sector of a linear
+   directory, or the buckets of a hashed one.  Returns false if
+   the index header cannot be read. */
+static bool
+record_sectors (const struct dir *dir, off_t *firstp, off_t *endp)
+{
+  if (inode_is_indexed (dir->inode))
+    {
+      uint32_t bucket_cnt;
+      if (inode_read_at (dir->inode, &bucket_cnt, sizeof bucket_cnt,
+                         offsetof (struct dir_index, bucket_cnt))
+          != sizeof bucket_cnt)
+        return false;
+
+      /* Skip the index header. */
+      *firstp = 1;
+      *endp = bucket_cnt + 1;
+    }
+  else
+    {
+      *firstp = 0;
+      *endp = DIV_ROUND_UP (inode_length (dir->inode), BLOCK_SECTOR_SIZE);
+    }
+  return true;
+}
+
+/* Reads the first in-use record at or after *POS in DIR into *EP
+   and advances *POS past it.  Sets *OFSP to the record's byte
+   offset if OFSP is non-null.  Works for both the linear and the
+   hashed layout.  Returns false once there are no more entries.
+
+   The containing record area is always walked from its start, so
+   that a *POS left inside a record that has since been merged
+   into its predecessor is never mistaken for a live entry. */
+static bool
+read_next_entry (const struct dir *dir, off_t *pos, struct dir_entry *ep,
+                 off_t *ofsp)
+{
+  off_t start = area_start (dir);
+  size_t size = BLOCK_SECTOR_SIZE - start;
+  off_t first, sector_cnt;
+  uint8_t *area;
+  bool found = false;
+
+  if (!record_sectors (dir, &first, &sector_cnt))
+    return false;
+  if (*pos < first * BLOCK_SECTOR_SIZE)
+    *pos = first * BLOCK_SECTOR_SIZE;
+
+  area = malloc (size);
+  if (area == NULL)
+    return false;
+
+  while (!found && *pos / BLOCK_SECTOR_SIZE < sector_cnt)
+    {
+      off_t sector_ofs = ROUND_DOWN (*pos, BLOCK_SECTOR_SIZE);
+      struct dir_record *r;
+      size_t ofs;
+
+      read_area (dir, sector_ofs + start, area, size);
+      for (ofs = 0; ofs < size; ofs += r->rec_len)
+        {
+          r = record_at (area, ofs);
+          if (r->rec_len == 0)
+            break;
+          if (sector_ofs + start + (off_t) ofs >= *pos && r->name_len != 0)
+            {
+              record_to_entry (r, ep);
+              if (ofsp != NULL)
+                *ofsp = sector_ofs + start + ofs;
+              *pos = sector_ofs + start + ofs + r->rec_len;
+              found = true;
+              break;
+            }
+        }
+      if (!found)
+        *pos = sector_ofs + BLOCK_SECTOR_SIZE;
+    }
+
+  free (area);
+  return found;
+}
+
+/* Appends *E to linear directory DIR, in the first sector with
+   room for it.  A directory that is already DIR_LINEAR_SECTORS
+   long is converted to the hashed layout instead of growing. */
+static bool
+linear_add (struct dir *dir, const struct dir_entry *e)
+{
+  off_t sector_cnt = DIV_ROUND_UP (inode_length (dir->inode),
+                                   BLOCK_SECTOR_SIZE);
+  uint8_t *area = malloc (BLOCK_SECTOR_SIZE);
+  bool success = false;
+  off_t sector;
+
+  if (area == NULL)
+    return false;
+
+  for (sector = 0; sector < sector_cnt; sector++)
+    {
+      read_area (dir, sector * BLOCK_SECTOR_SIZE, area, BLOCK_SECTOR_SIZE);
+      if (area_insert (area, BLOCK_SECTOR_SIZE, e))
+        goto write;
+    }
+
+  if (sector_cnt >= DIR_LINEAR_SECTORS)
+    {
+      success = index_convert (dir) && index_add (dir, e);
+      goto done;
+    }
+
+  area_init (area, BLOCK_SECTOR_SIZE);
+  area_insert (area, BLOCK_SECTOR_SIZE, e);
+
+ write:
+  success = inode_write_at (dir->inode, area, BLOCK_SECTOR_SIZE,
+                            sector * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+ done:
+  free (area);
+  return success;
+}
+
+/* Returns the mask selecting the low DEPTH bits of a hash. */
+static inline unsigned
+depth_mask (uint32_t depth)
+{
+  return (1u << depth) - 1;
+}
+
+/* Reads DIR's index header into *IDX. */
+static bool
+index_read (const struct dir *dir, struct dir_index *idx)
+{
+  return (inode_read_at (dir->inode, idx, sizeof *idx, 0) == sizeof *idx
+          && idx->magic == DIR_INDEX_MAGIC);
+}
+
+/* Writes *IDX as DIR's index header. */
+static bool
+index_write (struct dir *dir, const struct dir_index *idx)
+{
+  return inode_write_at (dir->inode, idx, sizeof *idx, 0) == sizeof *idx;
+}
+
+/* Reads bucket B of DIR into *BUCKET. */
+static bool
+bucket_read (const struct dir *dir, uint16_t b, struct dir_bucket *bucket)
+{
+  return inode_read_at (dir->inode, bucket, sizeof *bucket,
+                        b * BLOCK_SECTOR_SIZE) == sizeof *bucket;
+}
+
+/* Writes *BUCKET as bucket B of DIR. */
+static bool
+bucket_write (struct dir *dir, uint16_t b, const struct dir_bucket *bucket)
+{
+  return inode_write_at (dir->inode, bucket, sizeof *bucket,
+                         b * BLOCK_SECTOR_SIZE) == sizeof *bucket;
+}
+
+/* Searches hashed directory DIR for NAME.  Only the index header
+   and the bucket chain NAME hashes to are read.  Behaves like
+   lookup(). */
+static bool
+index_lookup (const struct dir *dir, const char *name,
+              struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_index *idx = malloc (sizeof *idx);
+  struct dir_bucket *bucket = malloc (sizeof *bucket);
+  bool found = false;
+  uint16_t b;
+  int ofs;
+
+  if (idx == NULL || bucket == NULL || !index_read (dir, idx))
+    goto done;
+
+  b = idx->table[hash_string (name) & depth_mask (idx->global_depth)];
+  for (; b != 0 && !found; b = bucket->next)
+    {
+      if (!bucket_read (dir, b, bucket))
+        break;
+      ofs = area_find (bucket->records, DIR_BUCKET_AREA, name);
+      if (ofs >= 0)
+        {
+          if (ep != NULL)
+            record_to_entry (record_at (bucket->records, ofs), ep);
+          if (ofsp != NULL)
+            *ofsp = (b * BLOCK_SECTOR_SIZE
+                     + offsetof (struct dir_bucket, records) + ofs);
+          found = true;
+        }
+    }
+
+ done:
+  free (idx);
+  free (bucket);
+  return found;
+}
+
+/* Splits bucket B of hashed directory DIR, whose contents are in
+   *BUCKET, into two buckets one level deeper, doubling the table
+   in *IDX first if needed.  The records of both halves are
+   repacked from scratch.  Writes both buckets and the header. */
+static bool
+index_split (struct dir *dir, struct dir_index *idx, uint16_t b,
+             struct dir_bucket *bucket)
+{
+  struct dir_bucket *old, *sibling;
+  struct dir_entry e;
+  struct dir_record *r;
+  uint16_t nb;
+  unsigned bit;
+  size_t i, ofs;
+  bool success;
+
+  ASSERT (bucket->local_depth < DIR_MAX_DEPTH);
+
+  old = malloc (sizeof *old);
+  sibling = calloc (1, sizeof *sibling);
+  if (old == NULL || sibling == NULL)
+    {
+      free (old);
+      free (sibling);
+      return false;
+    }
+
+  /* Double the table so that it can tell the halves apart. */
+  if (bucket->local_depth == idx->global_depth)
+    {
+      size_t slots = 1 << idx->global_depth;
+      for (i = 0; i < slots; i++)
+        idx->table[i + slots] = idx->table[i];
+      idx->global_depth++;
+    }
+
+  /* Deal the records out by their next hash bit.  Each half holds
+     a subset of a bucket that fit, so the inserts cannot fail. */
+  *old = *bucket;
+  nb = ++idx->bucket_cnt;
+  bit = 1u << bucket->local_depth;
+  bucket->local_depth++;
+  sibling->local_depth = bucket->local_depth;
+  area_init (bucket->records, DIR_BUCKET_AREA);
+  area_init (sibling->records, DIR_BUCKET_AREA);
+  for (ofs = 0; ofs < DIR_BUCKET_AREA; ofs += r->rec_len)
+    {
+      r = record_at (old->records, ofs);
+      if (r->rec_len == 0)
+        break;
+      if (r->name_len == 0)
+        continue;
+      record_to_entry (r, &e);
+      area_insert (hash_string (e.name) & bit ? sibling->records
+                                              : bucket->records,
+                   DIR_BUCKET_AREA, &e);
+    }
+
+  for (i = 0; i < (size_t) (1 << idx->global_depth); i++)
+    if (idx->table[i] == b && (i & bit))
+      idx->table[i] = nb;
+
+  success = (bucket_write (dir, nb, sibling)
+             && bucket_write (dir, b, bucket)
+             && index_write (dir, idx));
+  free (old);
+  free (sibling);
+  return success;
+}
+
+/* Inserts *E into hashed directory DIR.  A full bucket is split
+   until the entry fits; once a bucket reaches DIR_MAX_DEPTH, an
+   overflow bucket is chained to it instead. */
+static bool
+index_add (struct dir *dir, const struct dir_entry *e)
+{
+  struct dir_index *idx = malloc (sizeof *idx);
+  struct dir_bucket *bucket = malloc (sizeof *bucket);
+  unsigned hash = hash_string (e->name);
+  bool success = false;
+  uint16_t b, cur, last;
+
+  if (idx == NULL || bucket == NULL || !index_read (dir, idx))
+    goto done;
+
+  for (;;)
+    {
+      /* Look for room along the bucket's chain. */
+      b = idx->table[hash & depth_mask (idx->global_depth)];
+      for (cur = last = b; cur != 0; cur = bucket->next)
+        {
+          if (!bucket_read (dir, cur, bucket))
+            goto done;
+          if (area_insert (bucket->records, DIR_BUCKET_AREA, e))
+            {
+              success = bucket_write (dir, cur, bucket);
+              goto done;
+            }
+          last = cur;
+        }
+
+      /* Only buckets without overflow chains are split; those
+         with chains have already reached the maximum depth. */
+      if (last == b && bucket->local_depth < DIR_MAX_DEPTH)
+        {
+          if (!index_split (dir, idx, b, bucket))
+            goto done;
+          continue;
+        }
+
+      /* Chain a new overflow bucket after LAST. */
+      cur = ++idx->bucket_cnt;
+      bucket->next = cur;
+      if (!bucket_write (dir, last, bucket))
+        goto done;
+      memset (bucket, 0, sizeof *bucket);
+      bucket->local_depth = DIR_MAX_DEPTH;
+      area_init (bucket->records, DIR_BUCKET_AREA);
+      area_insert (bucket->records, DIR_BUCKET_AREA, e);
+      success = bucket_write (dir, cur, bucket) && index_write (dir, idx);
+      goto done;
+    }
+
+ done:
+  free (idx);
+  free (bucket);
+  return success;
+}
+
+/* Rewrites DIR in the linear layout from SECTOR_CNT sectors of
+   records saved in SECTORS, leaving any sectors past them empty,
+   and marks it linear again.  Used to undo a failed conversion to
+   the hashed layout.  Only sectors the directory already has are
+   written, so this needs no free space. */
+static void
+linear_restore (struct dir *dir, const uint8_t *sectors, off_t sector_cnt)
+{
+  off_t new_cnt = DIV_ROUND_UP (inode_length (dir->inode),
+                                BLOCK_SECTOR_SIZE);
+  uint8_t area[sizeof (struct dir_record)];
+  off_t sector;
+
+  inode_write_at (dir->inode, sectors, sector_cnt * BLOCK_SECTOR_SIZE, 0);
+
+  /* A sector whose first record is cleared reads back as an empty
+     area; see read_area(). */
+  memset (area, 0, sizeof area);
+  for (sector = sector_cnt; sector < new_cnt; sector++)
+    inode_write_at (dir->inode, area, sizeof area,
+                    sector * BLOCK_SECTOR_SIZE);
+  inode_set_indexed (dir->inode, false);
+}
+
+/* Converts linear directory DIR to the hashed layout.  The
+   existing records are rehashed into buckets that overwrite the
+   old linear sectors.  If that fails partway, the linear layout
+   is put back, so no entry is lost. */
+static bool
+index_convert (struct dir *dir)
+{
+  off_t sector_cnt = DIV_ROUND_UP (inode_length (dir->inode),
+                                   BLOCK_SECTOR_SIZE);
+  uint8_t *sectors = malloc (sector_cnt * BLOCK_SECTOR_SIZE);
+  struct dir_index *idx = calloc (1, sizeof *idx);
+  struct dir_bucket *bucket = calloc (1, sizeof *bucket);
+  struct dir_entry e;
+  struct dir_record *r;
+  bool success = false;
+  off_t sector;
+  size_t ofs;
+
+  if (sectors == NULL || idx == NULL || bucket == NULL)
+    goto done;
+
+  /* Save the linear records before the header overwrites them. */
+  for (sector = 0; sector < sector_cnt; sector++)
+    read_area (dir, sector * BLOCK_SECTOR_SIZE,
+               sectors + sector * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+
+  /* Start with a single bucket that every hash maps to. */
+  idx->magic = DIR_INDEX_MAGIC;
+  idx->global_depth = 0;
+  idx->bucket_cnt = 1;
+  idx->table[0] = 1;
+  area_init (bucket->records, DIR_BUCKET_AREA);
+  if (!index_write (dir, idx) || !bucket_write (dir, 1, bucket))
+    {
+      linear_restore (dir, sectors, sector_cnt);
+      goto done;
+    }
+  inode_set_indexed (dir->inode, true);
+
+  success = true;
+  for (sector = 0; sector < sector_cnt && success; sector++)
+    {
+      uint8_t *area = sectors + sector * BLOCK_SECTOR_SIZE;
+      for (ofs = 0; ofs < BLOCK_SECTOR_SIZE && success; ofs += r->rec_len)
+        {
+          r = record_at (area, ofs);
+          if (r->rec_len == 0)
+            break;
+          if (r->name_len == 0)
+            continue;
+          record_to_entry (r, &e);
+          success = index_add (dir, &e);
+        }
+    }
+  if (!success)
+    linear_restore (dir, sectors, sector_cnt);
+
+ done:
+  free (sectors);
+  free (idx);
+  free (bucket);
+  return success;
+}
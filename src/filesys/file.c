@@ -1,7 +1,17 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Cache of 'struct file's. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void)
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+}
 
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
@@ -9,7 +19,7 @@
 struct file *
 file_open (struct inode *inode)
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (file_cache);
   if (inode != NULL && file != NULL && !inode_is_removed (inode))
     {
       file->inode = inode;
@@ -20,7 +30,7 @@ file_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL;
     }
 }
@@ -41,7 +51,7 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
     }
 }
 
@@ -76,6 +86,19 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into the pages PAGES[0], PAGES[1],
+   ..., a page at a time, starting at offset FILE_OFS in the file,
+   with as few waits for the disk as possible.  The pages must be
+   in the kernel's direct map.  Returns the number of bytes
+   actually read, which may be less than SIZE if end of file is
+   reached.  The file's current position is unaffected. */
+off_t
+file_read_pages (struct file *file, void *pages[], off_t size,
+                 off_t file_ofs)
+{
+  return inode_read_pages (file->inode, pages, size, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written.
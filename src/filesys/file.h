@@ -14,6 +14,8 @@ struct file
     bool deny_write;            /* Has file_deny_write() been called? */
   };
 
+void file_init (void);
+
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
@@ -23,6 +25,8 @@ struct inode *file_get_inode (struct file *);
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
+off_t file_read_pages (struct file *, void *pages[], off_t size,
+                       off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 
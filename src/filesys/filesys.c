@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "threads/thread.h"
 
 /* Partition that contains the file system. */
@@ -24,6 +25,9 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  file_init ();
+  dir_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format)
@@ -90,6 +94,27 @@ filesys_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Deletes the file or directory named NAME and, if it is a
+   directory, everything beneath it.  The sectors of every removed
+   inode are released with a single free map write.
+   Returns true if successful, false on failure.
+   Fails if no file named NAME exists,
+   or if an internal memory allocation fails. */
+bool
+filesys_rmtree (struct dir *dir, const char *name)
+{
+  bool success;
+
+  if (dir == NULL)
+    return false;
+
+  free_map_batch_begin ();
+  success = dir_rmtree (dir, name);
+  free_map_batch_end ();
+
+  return success;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
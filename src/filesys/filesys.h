@@ -17,5 +17,6 @@ void filesys_done (void);
 bool filesys_create (struct dir *, const char *, off_t, bool);
 struct file *filesys_open (struct dir *, const char *);
 bool filesys_remove (struct dir *, const char *);
+bool filesys_rmtree (struct dir *, const char *);
 
 #endif /* filesys/filesys.h */
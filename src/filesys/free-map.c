@@ -10,6 +10,12 @@ static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 struct lock free_map_lock;           /* Free map lock. */
 
+/* Releases made while a batch is open only update the in-memory
+   bitmap; it is written back once, when the outermost batch
+   ends. */
+static int batch_depth;              /* Number of open batches. */
+static bool batch_dirty;             /* Released sectors not written? */
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -54,7 +60,37 @@ free_map_release (block_sector_t sector, size_t cnt)
   lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  if (batch_depth > 0)
+    batch_dirty = true;
+  else
+    bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
+}
+
+/* Starts a batch of releases.  Until the matching
+   free_map_batch_end(), free_map_release() does not write the
+   free map to disk.  Batches may nest. */
+void
+free_map_batch_begin (void)
+{
+  lock_acquire (&free_map_lock);
+  batch_depth++;
+  lock_release (&free_map_lock);
+}
+
+/* Ends a batch of releases started by free_map_batch_begin().
+   Ending the outermost batch writes the free map to disk once if
+   any sectors were released during it. */
+void
+free_map_batch_end (void)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (batch_depth > 0);
+  if (--batch_depth == 0 && batch_dirty)
+    {
+      bitmap_write (free_map, free_map_file);
+      batch_dirty = false;
+    }
   lock_release (&free_map_lock);
 }
 
@@ -13,5 +13,7 @@ void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_batch_begin (void);
+void free_map_batch_end (void);
 
 #endif /* filesys/free-map.h */
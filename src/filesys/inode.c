@@ -7,6 +7,8 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
 #include "filesys/cache.h"
 
 /* Identifies an inode. */
@@ -15,7 +17,7 @@
 /* Number of inode_disk objects that are not part of the inode's first level
    hierarchy.  Used to determine how many sectors the first level should
    have. */
-#define NUM_METADATA_INDIR_DOUB 6
+#define NUM_METADATA_INDIR_DOUB 7
 
 /* Size of the inode hierarchy first level. */
 #define FIRSTLEVEL_SIZE ((BLOCK_SECTOR_SIZE / 4) - NUM_METADATA_INDIR_DOUB)
@@ -52,13 +54,15 @@ struct inode
 
 /* On-disk inode.  Since it must be BLOCK_SECTOR_SIZE bytes long,
    the first level indexing is based on the metadata size.  In
-   declaration order: 4 + 4 + 4 + 4 + 4*FIRSTLEVEL_SIZE + 4 + 4 = 512. */
+   declaration order: 4 + 4 + 4 + 4 + 4 + 4*FIRSTLEVEL_SIZE + 4 + 4 = 512. */
 struct inode_disk
   {
     uint32_t length;         /* File size in bytes. */
     uint32_t num_blocks;     /* Number of blocks allocated to this file. */
     unsigned magic;          /* Magic number. */
     unsigned is_file;        /* Is this inode a file? */
+    unsigned is_indexed;     /* Does this directory use the hashed
+                                layout? */
     block_sector_t first_level[FIRSTLEVEL_SIZE]; /* First level blocks. */
     block_sector_t indir_level;       /* Indirect sector. */
     block_sector_t doub_indir_level;  /* Doubly-indirect sector. */
@@ -77,6 +81,17 @@ static struct list open_inodes; /* List of open inodes, so that opening a
                                    'struct inode'. */
 struct lock open_inodes_lock; /* Lock for open_inodes list. */
 
+static struct kmem_cache *inode_cache; /* Cache of 'struct inode's. */
+
+/* Constructs INODE_ in inode_cache.  An inode is freed with its
+   lock released, so the lock needs initializing only once. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  lock_init (&inode->inode_lock);
+}
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -170,6 +185,33 @@ inode_is_file (const struct inode *inode)
     return true;
 }
 
+/* Returns true if INODE is a directory that uses the hashed entry
+   layout, false if it uses the linear layout (or is a file). */
+bool
+inode_is_indexed (const struct inode *inode)
+{
+  ASSERT (inode != NULL);
+
+  struct inode_disk index_idisk;
+  cache_read (inode->sector, &index_idisk, BLOCK_SECTOR_SIZE, 0);
+  return index_idisk.is_indexed != 0;
+}
+
+/* Records whether directory INODE uses the hashed entry layout. */
+void
+inode_set_indexed (struct inode *inode, bool indexed)
+{
+  ASSERT (inode != NULL);
+
+  bool lock_success = inode_grab_lock (inode);
+  struct inode_disk index_idisk;
+  cache_read (inode->sector, &index_idisk, BLOCK_SECTOR_SIZE, 0);
+  index_idisk.is_indexed = indexed;
+  cache_write (inode->sector, &index_idisk, BLOCK_SECTOR_SIZE, 0);
+  if (lock_success)
+    inode_release_lock (inode);
+}
+
 /* Returns true if the inode has been deleted and is no longer in use. */
 bool
 inode_is_removed (struct inode *inode)
@@ -178,6 +220,14 @@ inode_is_removed (struct inode *inode)
   return inode->removed;
 }
 
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (struct inode *inode)
+{
+  ASSERT (inode != NULL);
+  return inode->open_cnt;
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void)
@@ -185,6 +235,8 @@ inode_init (void)
   cache_init ();
   list_init (&open_inodes);
   lock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode),
+                                   inode_ctor);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -255,7 +307,7 @@ inode_open (block_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
     {
       lock_release (&open_inodes_lock);
@@ -269,7 +321,6 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init (&inode->inode_lock);
   lock_release (&open_inodes_lock);
 
   return inode;
@@ -324,8 +375,10 @@ inode_close (struct inode *inode)
           cache_read (inode->sector, &close_idisk,
             BLOCK_SECTOR_SIZE, 0);
 
+          /* Write the free map once rather than once per block. */
           size_t b;
           block_sector_t close_block;
+          free_map_batch_begin ();
           for (b = 0; b < close_idisk.num_blocks; b++)
             {
               close_block = block_lookup (&close_idisk, b);
@@ -333,8 +386,9 @@ inode_close (struct inode *inode)
             }
 
           free_map_release (inode->sector, 1);
+          free_map_batch_end ();
         }
-      free (inode);
+      kmem_cache_free (inode_cache, inode);
     }
   else
     lock_release (&open_inodes_lock);
@@ -388,7 +442,23 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      cache_read (sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
+      /* Read a run of whole sectors that are consecutive on disk
+         with as few disk requests as possible. */
+      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+          && size >= 2 * BLOCK_SECTOR_SIZE
+          && inode_left >= 2 * BLOCK_SECTOR_SIZE)
+        {
+          int run = 1;
+          while ((run + 1) * BLOCK_SECTOR_SIZE <= size
+                 && (run + 1) * BLOCK_SECTOR_SIZE <= inode_left
+                 && (byte_to_sector (inode, offset + run * BLOCK_SECTOR_SIZE)
+                     == sector_idx + run))
+            run++;
+          chunk_size = run * BLOCK_SECTOR_SIZE;
+          cache_read_multiple (sector_idx, buffer + bytes_read, run);
+        }
+      else
+        cache_read (sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
 
       /* Advance. */
       size -= chunk_size;
@@ -421,6 +491,71 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Reads SIZE bytes from INODE, starting at OFFSET, into the
+   pages PAGES[0], PAGES[1], ..., a page at a time.  Returns the
+   number of bytes read, which may be less than SIZE if end of
+   file is reached.  The pages must be in the kernel's direct
+   map.  If OFFSET is a multiple of the sector size, as it is
+   for pages of an executable or a file mapping, the sectors are
+   read in a single batch by cache_read_sectors(); otherwise a
+   page at a time. */
+off_t
+inode_read_pages (struct inode *inode, void *pages[], off_t size,
+                  off_t offset)
+{
+  enum { SECTORS_PER_PAGE = PGSIZE / BLOCK_SECTOR_SIZE };
+  off_t length = inode_length (inode);
+  block_sector_t *sectors;
+  void **buffers;
+  size_t sector_cnt, i;
+
+  if (offset >= length)
+    return 0;
+  if (size > length - offset)
+    size = length - offset;
+
+  sector_cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  sectors = malloc (sector_cnt * sizeof *sectors);
+  buffers = malloc (sector_cnt * sizeof *buffers);
+  if (offset % BLOCK_SECTOR_SIZE != 0 || sectors == NULL
+      || buffers == NULL)
+    {
+      off_t bytes_read = 0;
+
+      free (sectors);
+      free (buffers);
+      for (i = 0; bytes_read < size; i++)
+        {
+          off_t chunk = size - bytes_read < PGSIZE ? size - bytes_read
+                                                   : PGSIZE;
+          off_t n = inode_read_at (inode, pages[i], chunk,
+                                   offset + bytes_read);
+          bytes_read += n;
+          if (n < chunk)
+            break;
+        }
+      return bytes_read;
+    }
+
+  for (i = 0; i < sector_cnt; i++)
+    {
+      sectors[i] = byte_to_sector (inode,
+                                   offset + i * BLOCK_SECTOR_SIZE);
+      buffers[i] = ((uint8_t *) pages[i / SECTORS_PER_PAGE]
+                    + i % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+    }
+  cache_read_sectors (sectors, buffers, sector_cnt);
+
+  /* The last sector may hold bytes past the end of the file. */
+  if (size % BLOCK_SECTOR_SIZE != 0)
+    memset ((uint8_t *) buffers[sector_cnt - 1] + size % BLOCK_SECTOR_SIZE,
+            0, BLOCK_SECTOR_SIZE - size % BLOCK_SECTOR_SIZE);
+
+  free (sectors);
+  free (buffers);
+  return size;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
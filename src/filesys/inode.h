@@ -16,11 +16,16 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_pages (struct inode *, void *pages[], off_t size,
+                        off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_is_file (const struct inode *);
+bool inode_is_indexed (const struct inode *);
+void inode_set_indexed (struct inode *, bool);
 bool inode_is_removed (struct inode *);
+int inode_open_cnt (struct inode *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,47 @@
+#ifndef __LIB_BLKSTAT_H
+#define __LIB_BLKSTAT_H
+
+/* Block device statistics returned by the blkstat() system call.
+   Shared between the kernel and user programs. */
+
+#include <stdint.h>
+
+/* Latency histograms have BLKSTAT_BUCKETS buckets on a log2 scale
+   of cycle counter ticks.  Bucket 0 counts latencies under
+   2**BLKSTAT_SHIFT cycles, bucket I > 0 those from
+   2**(BLKSTAT_SHIFT + I - 1) up to twice that, and the last bucket
+   also everything longer. */
+#define BLKSTAT_BUCKETS 24
+#define BLKSTAT_SHIFT 10
+
+/* Statistics for one block device.
+
+   The request and sector counts cover every request submitted to
+   the device.  Depth and latency are measured at the device that
+   carries requests out, so for a partition they are found on the
+   disk that contains it.  A request waits in the queue from its
+   submission until the device starts on it, and is in service
+   from then until it completes. */
+struct blkstat
+  {
+    uint64_t read_cnt;          /* Sectors read. */
+    uint64_t write_cnt;         /* Sectors written. */
+    uint64_t requests;          /* Requests submitted. */
+    uint64_t sequential;        /* Requests that began where the
+                                   previous one ended. */
+
+    uint32_t in_flight;         /* Requests not yet completed. */
+    uint32_t max_in_flight;     /* Highest IN_FLIGHT seen. */
+    uint64_t depth_sum;         /* Sum of IN_FLIGHT seen by each
+                                   request as it was started. */
+    uint64_t completed;         /* Requests completed. */
+
+    uint64_t queue_cycles;      /* Total queue wait. */
+    uint64_t service_cycles;    /* Total service time. */
+    uint64_t queue_hist[BLKSTAT_BUCKETS];       /* Queue waits. */
+    uint64_t service_hist[BLKSTAT_BUCKETS];     /* Service times. */
+
+    uint64_t cycles_per_ms;     /* Cycle counter rate, 0 if unknown. */
+  };
+
+#endif /* lib/blkstat.h */
@@ -0,0 +1,30 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Directory entry records returned by the getdents() system
+   call.  Shared between the kernel and user programs. */
+
+#include <stddef.h>
+#include <round.h>
+
+/* Values for d_type. */
+#define DT_REG 1                /* Ordinary file. */
+#define DT_DIR 2                /* Directory. */
+
+/* A directory entry.  getdents() packs these back to back into
+   the caller's buffer; the next record starts D_RECLEN bytes
+   after this one. */
+struct dirent
+  {
+    int d_ino;                  /* Inode number. */
+    unsigned short d_reclen;    /* Length of this record in bytes. */
+    unsigned char d_type;       /* DT_REG or DT_DIR. */
+    char d_name[1];             /* Null terminated name, variable length. */
+  };
+
+/* Length of a record whose name is NAME_LEN bytes long, not
+   counting the null terminator.  Keeps records word aligned. */
+#define DIRENT_RECLEN(NAME_LEN) \
+        ROUND_UP (offsetof (struct dirent, d_name) + (NAME_LEN) + 1, 4)
+
+#endif /* lib/dirent.h */
@@ -0,0 +1,164 @@
+#include "lz.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Compressed data is a sequence of items, each introduced by a
+   control byte C:
+
+     - If C < 0x80, C + 1 literal bytes follow, to be copied to
+       the output as is.
+
+     - Otherwise, the item is a match: the next two bytes are a
+       little-endian distance D, and (C & 0x7f) + LZ_MIN_MATCH
+       bytes are copied from D bytes back in the output.  The
+       source and destination of the copy may overlap, so a run
+       of one repeated byte takes one literal and a few matches.
+
+   A match costs 3 bytes, so only matches of at least 4 bytes
+   are worth taking.  The compressor finds them by hashing each
+   position's first LZ_MIN_MATCH bytes into a table of the last
+   position with the same hash.  It is greedy and only looks at
+   one candidate per position, trading ratio for speed. */
+
+#define LZ_MIN_MATCH 4                          /* Shortest match. */
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)      /* Longest match. */
+#define LZ_MAX_LITERALS 0x80                    /* Longest literal run. */
+#define LZ_MAX_DISTANCE 0xffff                  /* Farthest match. */
+
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+/* Returns the hash table index for the LZ_MIN_MATCH bytes at P. */
+static inline unsigned
+hash_bytes4 (const uint8_t *p)
+{
+  uint32_t v = (p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16)
+                | ((uint32_t) p[3] << 24));
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the LEN literal bytes at LIT to the output at *DST,
+   which ends at DST_END, as one or more literal items.  Returns
+   false if the output does not fit. */
+static bool
+put_literals (uint8_t **dst, uint8_t *dst_end, const uint8_t *lit,
+              size_t len)
+{
+  while (len > 0)
+    {
+      size_t run = len < LZ_MAX_LITERALS ? len : LZ_MAX_LITERALS;
+      if ((size_t) (dst_end - *dst) < run + 1)
+        return false;
+      *(*dst)++ = run - 1;
+      memcpy (*dst, lit, run);
+      *dst += run;
+      lit += run;
+      len -= run;
+    }
+  return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into the DST_CAP bytes at
+   DST, using the LZ_WORK_SIZE bytes at WORK as scratch memory.
+   Returns the compressed size, or 0 if it would exceed DST_CAP. */
+size_t
+lz_compress (const void *src_, size_t src_len,
+             void *dst_, size_t dst_cap, void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *src_end = src + src_len;
+  const uint8_t *lit = src;
+  const uint8_t *p = src;
+  uint8_t *dst = dst_;
+  uint8_t *dst_end = dst + dst_cap;
+  uint16_t *table = work;
+
+  ASSERT (src_len <= LZ_MAX_DISTANCE + 1);
+  ASSERT (LZ_HASH_SIZE * sizeof *table <= LZ_WORK_SIZE);
+
+  memset (table, 0xff, LZ_HASH_SIZE * sizeof *table);
+  while (src_end - p >= LZ_MIN_MATCH)
+    {
+      unsigned h = hash_bytes4 (p);
+      const uint8_t *cand = table[h] != 0xffff ? src + table[h] : NULL;
+      size_t len = 0;
+
+      table[h] = p - src;
+      if (cand != NULL)
+        {
+          size_t max = src_end - p;
+          if (max > LZ_MAX_MATCH)
+            max = LZ_MAX_MATCH;
+          while (len < max && cand[len] == p[len])
+            len++;
+        }
+
+      if (len < LZ_MIN_MATCH)
+        {
+          p++;
+          continue;
+        }
+
+      if (!put_literals (&dst, dst_end, lit, p - lit)
+          || dst_end - dst < 3)
+        return 0;
+      *dst++ = 0x80 | (len - LZ_MIN_MATCH);
+      *dst++ = (p - cand) & 0xff;
+      *dst++ = (p - cand) >> 8;
+      p += len;
+      lit = p;
+    }
+
+  if (!put_literals (&dst, dst_end, lit, src_end - lit))
+    return 0;
+  return dst - (uint8_t *) dst_;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, which must have been
+   produced by lz_compress(), into the DST_LEN bytes at DST.
+   Returns true if successful, false if the data is corrupt or
+   does not decompress to exactly DST_LEN bytes. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *src = src_;
+  const uint8_t *src_end = src + src_len;
+  uint8_t *dst = dst_;
+  uint8_t *dst_end = dst + dst_len;
+
+  while (src < src_end)
+    {
+      uint8_t c = *src++;
+
+      if (c < 0x80)
+        {
+          size_t run = c + 1;
+          if ((size_t) (src_end - src) < run
+              || (size_t) (dst_end - dst) < run)
+            return false;
+          memcpy (dst, src, run);
+          src += run;
+          dst += run;
+        }
+      else
+        {
+          size_t len = (c & 0x7f) + LZ_MIN_MATCH;
+          size_t dist;
+          const uint8_t *from;
+
+          if (src_end - src < 2)
+            return false;
+          dist = src[0] | (src[1] << 8);
+          src += 2;
+          if (dist == 0 || dist > (size_t) (dst - (uint8_t *) dst_)
+              || (size_t) (dst_end - dst) < len)
+            return false;
+
+          /* Byte by byte, since the ranges may overlap. */
+          for (from = dst - dist; len > 0; len--)
+            *dst++ = *from++;
+        }
+    }
+  return dst == dst_end;
+}
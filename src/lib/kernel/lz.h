@@ -0,0 +1,17 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Simple LZ77 compression for data of up to 64 kB. */
+
+/* Bytes of scratch memory that lz_compress() needs. */
+#define LZ_WORK_SIZE 8192
+
+size_t lz_compress (const void *src, size_t src_len,
+                    void *dst, size_t dst_cap, void *work);
+bool lz_decompress (const void *src, size_t src_len,
+                    void *dst, size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_RMTREE,                 /* Removes a directory tree. */
+    SYS_BLKSTAT,                /* Reads block device statistics. */
+    SYS_FORK                    /* Clones this process. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+getdents (int fd, void *buffer, unsigned size)
+{
+  return syscall3 (SYS_GETDENTS, fd, buffer, size);
+}
+
+bool
+rmtree (const char *dir)
+{
+  return syscall1 (SYS_RMTREE, dir);
+}
+
+bool
+blkstat (const char *device, struct blkstat *st)
+{
+  return syscall2 (SYS_BLKSTAT, device, st);
+}
+
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
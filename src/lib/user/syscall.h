@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <debug.h>
 
+struct blkstat;
+
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
@@ -45,4 +47,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int getdents (int fd, void *buffer, unsigned size);
+bool rmtree (const char *dir);
+bool blkstat (const char *device, struct blkstat *);
+pid_t fork (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,16 @@
+/* Passes a pointer to this program's read-only code as the
+   buffer for blkstat().  The process must be terminated with
+   exit code -1 and the code left unchanged. */
+
+#include <blkstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  msg ("blkstat(\"hda1\", %p): %d",
+       test_main, blkstat ("hda1", (struct blkstat *) test_main));
+  fail ("should have exited with -1");
+}
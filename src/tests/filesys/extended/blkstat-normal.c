@@ -0,0 +1,22 @@
+/* Reads the statistics of the file system partition, which must
+   show the sectors read to load this program, and checks that
+   asking for a device that does not exist fails. */
+
+#include <blkstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct blkstat st;
+
+  CHECK (blkstat ("hda1", &st), "blkstat \"hda1\"");
+  if (st.read_cnt == 0 || st.requests == 0)
+    fail ("no reads recorded on \"hda1\"");
+  if (st.completed > st.requests)
+    fail ("%llu requests completed of %llu submitted",
+          st.completed, st.requests);
+  CHECK (!blkstat ("nodev", &st), "blkstat \"nodev\" (must fail)");
+}
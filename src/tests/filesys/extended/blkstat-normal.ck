@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blkstat-normal) begin
+(blkstat-normal) blkstat "hda1"
+(blkstat-normal) blkstat "nodev" (must fail)
+(blkstat-normal) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($tree);
+$tree->{'a'}{"f$_"} = [''] foreach 0...11;
+$tree->{'a'}{"d$_"} = {} foreach 0...3;
+check_archive ($tree);
+pass;
@@ -0,0 +1,109 @@
+/* Creates a directory holding files and subdirectories, then
+   lists it with getdents() through a buffer that holds only a few
+   records at a time.  Every entry must be returned exactly once,
+   with the right type and inode number. */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 12
+#define DIR_CNT 4
+
+void
+test_main (void)
+{
+  bool seen_file[FILE_CNT], seen_dir[DIR_CNT];
+  char buf[64];
+  char name[16];
+  int fd, n, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (chdir ("a"), "chdir \"a\"");
+  msg ("create %d files and %d directories", FILE_CNT, DIR_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  for (i = 0; i < DIR_CNT; i++)
+    {
+      snprintf (name, sizeof name, "d%d", i);
+      CHECK (mkdir (name), "mkdir \"%s\"", name);
+    }
+  quiet = false;
+
+  CHECK ((fd = open ("/a")) > 1, "open \"/a\"");
+  CHECK (getdents (fd, buf, 4) == -1,
+         "getdents with a 4-byte buffer (must return -1)");
+
+  msg ("list \"/a\"");
+  memset (seen_file, 0, sizeof seen_file);
+  memset (seen_dir, 0, sizeof seen_dir);
+  while ((n = getdents (fd, buf, sizeof buf)) > 0)
+    {
+      int ofs;
+
+      for (ofs = 0; ofs < n; )
+        {
+          struct dirent *d = (struct dirent *) (buf + ofs);
+          bool *seen;
+          int expect_type, ino, entry_fd;
+
+          i = atoi (d->d_name + 1);
+          if (d->d_name[0] == 'f' && i >= 0 && i < FILE_CNT)
+            {
+              seen = &seen_file[i];
+              expect_type = DT_REG;
+            }
+          else if (d->d_name[0] == 'd' && i >= 0 && i < DIR_CNT)
+            {
+              seen = &seen_dir[i];
+              expect_type = DT_DIR;
+            }
+          else
+            fail ("unexpected entry \"%s\"", d->d_name);
+
+          if (*seen)
+            fail ("\"%s\" returned twice", d->d_name);
+          *seen = true;
+          if (d->d_type != expect_type)
+            fail ("\"%s\" has type %d", d->d_name, d->d_type);
+
+          entry_fd = open (d->d_name);
+          if (entry_fd < 2)
+            fail ("open \"%s\" failed", d->d_name);
+          ino = inumber (entry_fd);
+          close (entry_fd);
+          if (d->d_ino != ino)
+            fail ("\"%s\" has inode %d instead of %d",
+                  d->d_name, d->d_ino, ino);
+
+          if (d->d_reclen == 0)
+            fail ("\"%s\" has a zero record length", d->d_name);
+          ofs += d->d_reclen;
+        }
+    }
+  if (n != 0)
+    fail ("getdents returned %d", n);
+
+  for (i = 0; i < FILE_CNT; i++)
+    if (!seen_file[i])
+      fail ("\"f%d\" not listed", i);
+  for (i = 0; i < DIR_CNT; i++)
+    if (!seen_dir[i])
+      fail ("\"d%d\" not listed", i);
+  msg ("close \"/a\"");
+  close (fd);
+
+  CHECK ((fd = open ("f0")) > 1, "open \"f0\"");
+  CHECK (getdents (fd, buf, sizeof buf) == -1,
+         "getdents on a file (must return -1)");
+  msg ("close \"f0\"");
+  close (fd);
+}
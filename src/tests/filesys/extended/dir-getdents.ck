@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) chdir "a"
+(dir-getdents) create 12 files and 4 directories
+(dir-getdents) open "/a"
+(dir-getdents) getdents with a 4-byte buffer (must return -1)
+(dir-getdents) list "/a"
+(dir-getdents) close "/a"
+(dir-getdents) open "f0"
+(dir-getdents) getdents on a file (must return -1)
+(dir-getdents) close "f0"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($tree);
+for my $a (1...2) {
+    for my $b (0...1) {
+	next if $a == 1 && $b == 1;
+	for my $c (0...1) {
+	    for my $d (0...2) {
+		$tree->{$a}{$b}{$c}{$d} = [''];
+	    }
+	}
+    }
+}
+delete $tree->{2}{0}{0}{0};
+check_archive ($tree);
+pass;
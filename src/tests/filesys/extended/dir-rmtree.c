@@ -0,0 +1,31 @@
+/* Creates directories /0/0/0 through /2/1/1 and files in the
+   leaf directories, then removes whole subtrees of them, and a
+   single file, with rmtree().  The rest of the tree must be left
+   alone, as must a subtree holding the working directory. */
+
+#include <syscall.h>
+#include "tests/filesys/extended/mk-tree.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int fd;
+
+  make_tree (3, 2, 2, 3);
+  CHECK (rmtree ("/0"), "rmtree \"/0\"");
+  CHECK (open ("/0") == -1, "open \"/0\" (must return -1)");
+  CHECK (rmtree ("/1/1"), "rmtree \"/1/1\"");
+  CHECK (open ("/1/1/0/0") == -1, "open \"/1/1/0/0\" (must return -1)");
+  CHECK (rmtree ("/2/0/0/0"), "rmtree \"/2/0/0/0\"");
+  CHECK (open ("/2/0/0/0") == -1, "open \"/2/0/0/0\" (must return -1)");
+  CHECK (!rmtree ("/0"), "rmtree \"/0\" again (must fail)");
+  CHECK (!rmtree ("/2/9"), "rmtree \"/2/9\" (must fail)");
+  CHECK (chdir ("/1/0"), "chdir \"/1/0\"");
+  CHECK (!rmtree ("/1"), "rmtree \"/1\" (must fail)");
+  CHECK (chdir ("/"), "chdir \"/\"");
+  CHECK ((fd = open ("/1/0/1/2")) > 1, "open \"/1/0/1/2\"");
+  msg ("close \"/1/0/1/2\"");
+  close (fd);
+}
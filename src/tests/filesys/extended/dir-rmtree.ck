@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-rmtree) begin
+(dir-rmtree) creating /0/0/0/0 through /2/1/1/2...
+(dir-rmtree) open "/0/1/0/2"
+(dir-rmtree) close "/0/1/0/2"
+(dir-rmtree) rmtree "/0"
+(dir-rmtree) open "/0" (must return -1)
+(dir-rmtree) rmtree "/1/1"
+(dir-rmtree) open "/1/1/0/0" (must return -1)
+(dir-rmtree) rmtree "/2/0/0/0"
+(dir-rmtree) open "/2/0/0/0" (must return -1)
+(dir-rmtree) rmtree "/0" again (must fail)
+(dir-rmtree) rmtree "/2/9" (must fail)
+(dir-rmtree) chdir "/1/0"
+(dir-rmtree) rmtree "/1" (must fail)
+(dir-rmtree) chdir "/"
+(dir-rmtree) open "/1/0/1/2"
+(dir-rmtree) close "/1/0/1/2"
+(dir-rmtree) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Writes a file larger than the buffer cache, then reads it back
+   with single large read() calls into user memory: all of it, a
+   run of whole sectors, and a range at an unaligned offset.  By
+   then the start of the file has been evicted from the cache, so
+   whole uncached sectors must be read from disk on behalf of a
+   user buffer. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 49152
+
+static char buf[FILE_SIZE];
+static char rbuf[FILE_SIZE];
+
+static void
+check_read (int fd, size_t ofs, size_t size)
+{
+  int bytes_read;
+
+  msg ("read %zu bytes at offset %zu", size, ofs);
+  memset (rbuf, 0, size);
+  seek (fd, ofs);
+  bytes_read = read (fd, rbuf, size);
+  if (bytes_read != (int) size)
+    fail ("read %zu bytes at offset %zu returned %d",
+          size, ofs, bytes_read);
+  compare_bytes (rbuf, buf + ofs, size, ofs, "bigfile");
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("bigfile", 0), "create \"bigfile\"");
+  CHECK ((fd = open ("bigfile")) > 1, "open \"bigfile\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"bigfile\"");
+
+  check_read (fd, 0, FILE_SIZE);
+  check_read (fd, 1536, 9216);
+  check_read (fd, 100, 20000);
+
+  msg ("close \"bigfile\"");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(read-large) begin
+(read-large) create "bigfile"
+(read-large) open "bigfile"
+(read-large) write "bigfile"
+(read-large) read 49152 bytes at offset 0
+(read-large) read 9216 bytes at offset 1536
+(read-large) read 20000 bytes at offset 100
+(read-large) close "bigfile"
+(read-large) end
+EOF
+pass;
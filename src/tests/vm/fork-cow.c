@@ -0,0 +1,63 @@
+/* Forks a child that checks that it sees its parent's data,
+   stack and zero-filled pages, then overwrites them.  The parent
+   must not see the child's changes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 8192
+
+static char data[SIZE] = {1};
+static char bss[SIZE];
+
+/* Fails unless every byte of the SIZE-byte BUFFER is C. */
+static void
+check (const char *buffer, char c, const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buffer[i] != c)
+      fail ("%s byte %zu is '%c' instead of '%c'", name, i, buffer[i], c);
+}
+
+static void
+check_all (const char *stack, char c)
+{
+  check (data, c, "data");
+  check (bss, c, "bss");
+  check (stack, c, "stack");
+}
+
+static void
+fill_all (char *stack, char c)
+{
+  memset (data, c, SIZE);
+  memset (bss, c, SIZE);
+  memset (stack, c, SIZE);
+}
+
+void
+test_main (void)
+{
+  char stack[SIZE];
+  pid_t child;
+
+  fill_all (stack, 'p');
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      check_all (stack, 'p');
+      fill_all (stack, 'c');
+      check_all (stack, 'c');
+      exit (81);
+    }
+
+  CHECK (wait (child) == 81, "wait for child");
+  msg ("check parent's pages");
+  check_all (stack, 'p');
+  fill_all (stack, 'q');
+  check_all (stack, 'q');
+}
@@ -0,0 +1,56 @@
+/* Writes a 128 kB file through a memory mapping, forces the
+   mapped pages out of memory by touching 2 MB of other memory,
+   then checks the data through the mapping, and again with read()
+   after unmapping the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (128 * 1024)
+#define SIZE (2 * 1024 * 1024)
+
+static char *map = (char *) 0x10000000;
+static char big[SIZE];
+static char buf[FILE_SIZE];
+
+/* Fails unless the FILE_SIZE bytes at P hold the pattern written
+   by test_main(). */
+static void
+check (const char *p, const char *what)
+{
+  size_t i;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    if (p[i] != (char) (i * 257 + i / 4096))
+      fail ("byte %zu of %s is wrong", i, what);
+}
+
+void
+test_main (void)
+{
+  mapid_t id;
+  size_t i;
+  int handle;
+
+  CHECK (create ("buffer", FILE_SIZE), "create \"buffer\"");
+  CHECK ((handle = open ("buffer")) > 1, "open \"buffer\"");
+  CHECK ((id = mmap (handle, map)) != MAP_FAILED, "mmap \"buffer\"");
+
+  msg ("write mapping");
+  for (i = 0; i < FILE_SIZE; i++)
+    map[i] = i * 257 + i / 4096;
+
+  msg ("evict mapping");
+  memset (big, 0x5a, sizeof big);
+
+  msg ("check mapping");
+  check (map, "mapping");
+
+  msg ("munmap \"buffer\"");
+  munmap (id);
+  CHECK (read (handle, buf, FILE_SIZE) == FILE_SIZE, "read \"buffer\"");
+  check (buf, "\"buffer\"");
+  close (handle);
+}
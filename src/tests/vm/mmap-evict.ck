@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-evict) begin
+(mmap-evict) create "buffer"
+(mmap-evict) open "buffer"
+(mmap-evict) mmap "buffer"
+(mmap-evict) write mapping
+(mmap-evict) evict mapping
+(mmap-evict) check mapping
+(mmap-evict) munmap "buffer"
+(mmap-evict) read "buffer"
+(mmap-evict) end
+EOF
+pass;
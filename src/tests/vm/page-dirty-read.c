@@ -0,0 +1,77 @@
+/* Modifies a page of the data segment and a page mapped from a
+   file, then uses read() to fill in the end of each, which makes
+   the kernel map the pages for writing.  Both modifications must
+   survive having the pages evicted and the file unmapped. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define TAIL 64
+#define SIZE (2 * 1024 * 1024)
+
+static char data[PAGE_SIZE * 2] = {1};
+static char big[SIZE];
+static char buf[PAGE_SIZE];
+
+/* Checks that PAGE holds the sample text followed by zeros and
+   then the first TAIL bytes of the sample. */
+static void
+check_page (const char *page, const char *name)
+{
+  size_t i;
+
+  if (memcmp (page, sample, strlen (sample)))
+    fail ("%s lost the data written before read()", name);
+  for (i = strlen (sample); i < PAGE_SIZE - TAIL; i++)
+    if (page[i] != 0)
+      fail ("%s byte %zu is %d instead of 0", name, i, page[i]);
+  if (memcmp (page + PAGE_SIZE - TAIL, sample, TAIL))
+    fail ("%s lost the data read by read()", name);
+}
+
+void
+test_main (void)
+{
+  char *page = (char *) (((uintptr_t) data + PAGE_SIZE - 1)
+                         & ~(uintptr_t) (PAGE_SIZE - 1));
+  char *actual = (char *) 0x10000000;
+  int src, handle;
+  mapid_t map;
+
+  CHECK ((src = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("dirty.txt", PAGE_SIZE), "create \"dirty.txt\"");
+  CHECK ((handle = open ("dirty.txt")) > 1, "open \"dirty.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"dirty.txt\"");
+
+  msg ("modify pages");
+  memset (page, 0, PAGE_SIZE);
+  memcpy (page, sample, strlen (sample));
+  memcpy (actual, sample, strlen (sample));
+
+  msg ("read into modified pages");
+  if (read (src, page + PAGE_SIZE - TAIL, TAIL) != TAIL)
+    fail ("read into data page failed");
+  seek (src, 0);
+  if (read (src, actual + PAGE_SIZE - TAIL, TAIL) != TAIL)
+    fail ("read into mapped page failed");
+
+  msg ("evict pages");
+  memset (big, 0x5a, sizeof big);
+
+  msg ("check data page");
+  check_page (page, "data page");
+
+  msg ("munmap \"dirty.txt\"");
+  munmap (map);
+  if (read (handle, buf, PAGE_SIZE) != PAGE_SIZE)
+    fail ("read \"dirty.txt\" failed");
+  check_page (buf, "\"dirty.txt\"");
+
+  close (handle);
+  close (src);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-dirty-read) begin
+(page-dirty-read) open "sample.txt"
+(page-dirty-read) create "dirty.txt"
+(page-dirty-read) open "dirty.txt"
+(page-dirty-read) mmap "dirty.txt"
+(page-dirty-read) modify pages
+(page-dirty-read) read into modified pages
+(page-dirty-read) evict pages
+(page-dirty-read) check data page
+(page-dirty-read) munmap "dirty.txt"
+(page-dirty-read) end
+EOF
+pass;
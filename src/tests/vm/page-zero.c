@@ -0,0 +1,50 @@
+/* Reads every page of a 1 MB array in the BSS, which must all be
+   zeros, then writes to every other page.  The pages written must
+   hold what was written, and the rest must still be zeros, as
+   must pages read for the first time afterward. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 256
+
+static char zeros[PAGE_CNT][PAGE_SIZE];
+static char fresh[16][PAGE_SIZE];
+
+/* Fails unless each of the CNT pages at PAGES is all C, or all
+   zeros if it is an odd-numbered page and ODD_ZERO is true. */
+static void
+check_pages (char (*pages)[PAGE_SIZE], size_t cnt, char c, bool odd_zero)
+{
+  size_t i, j;
+
+  for (i = 0; i < cnt; i++)
+    {
+      char expect = odd_zero && i % 2 ? 0 : c;
+      for (j = 0; j < PAGE_SIZE; j++)
+        if (pages[i][j] != expect)
+          fail ("byte %zu of page %zu is %d instead of %d",
+                j, i, pages[i][j], expect);
+    }
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("read pages");
+  check_pages (zeros, PAGE_CNT, 0, false);
+
+  msg ("write even pages");
+  for (i = 0; i < PAGE_CNT; i += 2)
+    memset (zeros[i], 0x5a, PAGE_SIZE);
+
+  msg ("check pages");
+  check_pages (zeros, PAGE_CNT, 0x5a, true);
+
+  msg ("read fresh pages");
+  check_pages (fresh, 16, 0, false);
+}
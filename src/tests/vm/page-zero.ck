@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-zero) begin
+(page-zero) read pages
+(page-zero) write even pages
+(page-zero) check pages
+(page-zero) read fresh pages
+(page-zero) end
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Runs with user stacks limited to 64 kB.  Putting a 32 kB object
+   on the stack must work, but a 128 kB object crosses the limit,
+   and the process must be terminated with -1 exit code. */
+
+#include <stddef.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Writes to every page of a SIZE-byte object on the stack, from
+   the bottom up. */
+static void
+grow_stack (size_t size)
+{
+  char obj[size];
+  volatile char *p = obj;
+  size_t i;
+
+  for (i = 0; i < size; i += 4096)
+    p[i] = 1;
+}
+
+void
+test_main (void)
+{
+  msg ("put 32 kB on the stack");
+  grow_stack (32 * 1024);
+  msg ("put 128 kB on the stack");
+  grow_stack (128 * 1024);
+  fail ("should have exited with -1");
+}
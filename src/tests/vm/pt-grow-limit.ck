@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(pt-grow-limit) begin
+(pt-grow-limit) put 32 kB on the stack
+(pt-grow-limit) put 128 kB on the stack
+pt-grow-limit: exit(-1)
+EOF
+pass;
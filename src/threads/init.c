@@ -28,15 +28,25 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/vmalloc.h"
 #else
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -49,6 +59,16 @@ static bool format_filesys;
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -stripe: Comma-separated names of block devices to stripe the
+   file system across. */
+static char *stripe_members;
+
+/* -ramdisk, -ramdisk-size, -ramdisk-latency: Role, size in kB and
+   per-transfer delay in microseconds of a RAM disk to create. */
+static const char *ramdisk_role;
+static size_t ramdisk_size_kb = 1024;
+static int ramdisk_latency_us;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -68,6 +88,7 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+static void create_ramdisk (void);
 #endif
 
 int main (void) NO_RETURN;
@@ -98,6 +119,9 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef USERPROG
+  vmalloc_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -113,6 +137,7 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -123,10 +148,25 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_role != NULL)
+    create_ramdisk ();
+  if (stripe_members != NULL)
+    {
+      stripe_init (stripe_members);
+      if (filesys_bdev_name == NULL)
+        filesys_bdev_name = "stripe";
+    }
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init ();
+  swap_init ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -247,6 +287,14 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-stripe"))
+        stripe_members = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_role = value;
+      else if (!strcmp (name, "-ramdisk-size"))
+        ramdisk_size_kb = atoi (value);
+      else if (!strcmp (name, "-ramdisk-latency"))
+        ramdisk_latency_us = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -259,6 +307,14 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        page_stack_max = (size_t) atoi (value) * 1024;
+      else if (!strcmp (name, "-fault-around"))
+        page_around_max = atoi (value) > 0 ? atoi (value) : 1;
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value) > 0 ? atoi (value) : 0;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -376,6 +432,10 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -stripe=BDEV,...   Stripe file system across BDEVs.\n"
+          "  -ramdisk=ROLE      Use a RAM disk as filesys or scratch.\n"
+          "  -ramdisk-size=KB   Make the RAM disk KB kB (default 1024).\n"
+          "  -ramdisk-latency=US  Delay each RAM disk transfer by US us.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -384,12 +444,39 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stack=KB          Let user stacks grow to KB kB (default 8192).\n"
+          "  -fault-around=N    Map up to N file pages per fault (default 16).\n"
+          "  -zswap=PAGES       Keep up to PAGES pages of compressed swap in\n"
+          "                     memory (default 64, 0 to disable).\n"
 #endif
           );
   shutdown_power_off ();
 }
 
 #ifdef FILESYS
+/* Creates the RAM disk requested with -ramdisk and makes it the
+   default device for its role. */
+static void
+create_ramdisk (void)
+{
+  if (!strcmp (ramdisk_role, "filesys"))
+    {
+      ramdisk_init (BLOCK_FILESYS, ramdisk_size_kb, ramdisk_latency_us);
+      if (filesys_bdev_name == NULL)
+        filesys_bdev_name = "ram0";
+    }
+  else if (!strcmp (ramdisk_role, "scratch"))
+    {
+      ramdisk_init (BLOCK_SCRATCH, ramdisk_size_kb, ramdisk_latency_us);
+      if (scratch_bdev_name == NULL)
+        scratch_bdev_name = "ram0";
+    }
+  else
+    PANIC ("unknown RAM disk role `%s'", ramdisk_role);
+}
+
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
 locate_block_devices (void)
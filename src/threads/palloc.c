@@ -1,14 +1,15 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +24,54 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept in blocks of 2**ORDER pages, aligned to their size
+   relative to the start of the pool, on one free list per order.
+   A request for N pages takes a block of the smallest order that
+   fits, splitting larger blocks as needed, and gives back the
+   pages beyond the first N.  A freed block is merged with its
+   buddy, the other half of the block it was split from, for as
+   long as the buddy is also free.  Both take O(log n) time in the
+   size of the pool.
+
+   A free block's list element lives in its first page, and a
+   byte per page at the start of the pool records the order of
+   each free block's first page.
+
+   palloc_free_page() is called by thread_schedule_tail() with
+   interrupts off, where a lock cannot be acquired, so the free
+   lists are protected by disabling interrupts instead.  Each
+   operation on them is short. */
+
+/* Number of block orders: blocks are at most 2**(ORDER_CNT - 1)
+   pages. */
+#define ORDER_CNT 20
+
+/* Marks a page that does not begin a free block. */
+#define NOT_FREE 0xff
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    const char *name;                   /* Name, for statistics. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages. */
+    uint8_t *orders;                    /* Order of free block at each
+                                           page, or NOT_FREE. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks of each order. */
+    size_t free_cnts[ORDER_CNT];        /* Length of each free list. */
+    size_t free_pages;                  /* Total free pages. */
+
+    /* Statistics. */
+    long long get_cnt;                  /* Successful allocations. */
+    long long fail_cnt;                 /* Failed allocations. */
+    long long frag_fail_cnt;            /* Failures with enough pages free,
+                                           but not contiguous. */
+    long long free_cnt;                 /* Frees. */
+    uint64_t get_cycles, get_max;       /* Total and worst alloc time. */
+    uint64_t free_cycles, free_max;     /* Total and worst free time. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +80,9 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t get_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void record_time (uint64_t start, uint64_t *total, uint64_t *max);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -73,15 +117,29 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  enum intr_level old_level;
+  uint64_t start;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  start = timer_cycles ();
+  page_idx = get_pages (pool, page_cnt);
+  if (page_idx != SIZE_MAX)
+    {
+      pool->get_cnt++;
+      record_time (start, &pool->get_cycles, &pool->get_max);
+    }
+  else
+    {
+      pool->fail_cnt++;
+      if (pool->free_pages >= page_cnt)
+        pool->frag_fail_cnt++;
+    }
+  intr_set_level (old_level);
 
-  if (page_idx != BITMAP_ERROR)
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
@@ -119,6 +177,8 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
+  uint64_t start;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +197,12 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  start = timer_cycles ();
+  free_pages (pool, page_idx, page_cnt);
+  pool->free_cnt++;
+  record_time (start, &pool->free_cycles, &pool->free_max);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +212,202 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Prints the number of free blocks of each order in POOL, its
+   fragmentation, and the time taken to allocate and free pages. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  size_t largest = 0;
+  int order;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    if (pool->free_cnts[order] > 0)
+      largest = (size_t) 1 << order;
+
+  printf ("%s: %zu of %zu pages free, largest free block %zu pages, "
+          "%zu%% fragmented\n",
+          pool->name, pool->free_pages, pool->page_cnt, largest,
+          pool->free_pages > 0
+          ? 100 - largest * 100 / pool->free_pages : 0);
+  printf ("  free blocks by order:");
+  for (order = 0; order < ORDER_CNT; order++)
+    if (pool->free_cnts[order] > 0)
+      printf (" %d:%zu", order, pool->free_cnts[order]);
+  printf ("\n");
+  printf ("  %lld gets (avg %llu, max %llu cycles), "
+          "%lld frees (avg %llu, max %llu cycles)\n",
+          pool->get_cnt,
+          pool->get_cnt > 0 ? pool->get_cycles / pool->get_cnt : 0,
+          pool->get_max,
+          pool->free_cnt,
+          pool->free_cnt > 0 ? pool->free_cycles / pool->free_cnt : 0,
+          pool->free_max);
+  printf ("  %lld failed gets, %lld of them with enough pages free\n",
+          pool->fail_cnt, pool->frag_fail_cnt);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
+/* Initializes pool P as starting at BASE and containing PAGE_CNT
+   pages, naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's order map at its base.
+     Calculate the space needed for it
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t map_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int order;
+
+  if (map_pages > page_cnt)
+    PANIC ("Not enough memory in %s for order map.", name);
+  page_cnt -= map_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  p->orders = base;
+  p->base = base + map_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  memset (p->orders, NOT_FREE, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
+
+  /* Put all the pages on the free lists. */
+  free_pages (p, 0, page_cnt);
+}
+
+/* Returns the first page of block PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + page_idx * PGSIZE);
+}
+
+/* Returns the index in POOL of the block whose list element is E. */
+static size_t
+block_idx (struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX in POOL to its free
+   list. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+  pool->orders[page_idx] = order;
+  pool->free_cnts[order]++;
+}
+
+/* Removes the free block of 2**ORDER pages at PAGE_IDX in POOL
+   from its free list. */
+static void
+remove_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (pool->orders[page_idx] == order);
+  list_remove (block_elem (pool, page_idx));
+  pool->orders[page_idx] = NOT_FREE;
+  pool->free_cnts[order]--;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy for as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (pool->orders[page_idx] == NOT_FREE);
+
+  while (order < ORDER_CNT - 1)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->orders[buddy] != order)
+        break;
+      remove_block (pool, buddy, order);
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, as the largest
+   aligned blocks that cover them. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
+
+  pool->free_pages += page_cnt;
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order < ORDER_CNT - 1
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or SIZE_MAX if no block is large enough. */
+static size_t
+get_pages (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx;
+  int want, order;
+
+  /* Find the smallest order that holds PAGE_CNT pages, then the
+     smallest free block at least that large. */
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want >= ORDER_CNT - 1)
+      return SIZE_MAX;
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return SIZE_MAX;
+
+  page_idx = block_idx (pool, list_front (&pool->free_lists[order]));
+  remove_block (pool, page_idx, order);
+
+  /* Split off the upper halves until the block is the size
+     wanted. */
+  while (order > want)
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Give back the pages beyond PAGE_CNT. */
+  pool->free_pages -= (size_t) 1 << want;
+  if (page_cnt < ((size_t) 1 << want))
+    free_pages (pool, page_idx + page_cnt,
+                ((size_t) 1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Adds the cycles since START to *TOTAL and updates *MAX. */
+static void
+record_time (uint64_t start, uint64_t *total, uint64_t *max)
+{
+  uint64_t cycles = timer_cycles () - start;
+
+  *total += cycles;
+  if (cycles > *max)
+    *max = cycles;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +417,7 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
@@ -0,0 +1,261 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An object cache, or slab allocator.
+
+   malloc() rounds each request up to a power of 2, so an object
+   just over a power of 2 wastes nearly half its block, and it
+   hands back uninitialized memory.  A cache instead serves
+   objects of one exact size (rounded up only to a word) for a
+   kind of object allocated and freed often, such as inodes or
+   open files.
+
+   The cache obtains memory a page at a time from the page
+   allocator.  Each page, called a "slab", begins with a header
+   and is divided into objects.  Free objects in a slab are
+   chained through a pointer stored in each object, so allocating
+   and freeing take constant time.  Slabs with free objects are
+   kept on a list, partly used slabs in front of entirely free
+   ones, so that allocations fill up slabs that are already in
+   use.  One entirely free slab is kept to absorb a burst of
+   allocations; others are given back to the page allocator.
+
+   If the cache has a constructor, it is run on each object when
+   its slab is created, and the free pointer is stored just past
+   the object so that it doesn't disturb the constructed state. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t size;                /* Object size requested. */
+    size_t stride;              /* Bytes per object in a slab. */
+    size_t free_ofs;            /* Offset of free pointer in object. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct list_elem elem;      /* Element in `caches'. */
+
+    struct lock lock;           /* Protects the members below. */
+    struct list slabs;          /* Slabs with free objects. */
+    size_t slab_cnt;            /* Slabs in the cache. */
+    size_t empty_cnt;           /* Entirely free slabs. */
+
+    /* Statistics. */
+    long long alloc_cnt;        /* Allocations. */
+    long long free_cnt;         /* Frees. */
+    long long slabs_created;    /* Slabs obtained from palloc. */
+    size_t active;              /* Objects in use. */
+    size_t peak_active;         /* Maximum of `active'. */
+  };
+
+/* A slab. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's `slabs'. */
+    void *free;                 /* First free object. */
+    size_t free_cnt;            /* Number of free objects. */
+  };
+
+/* All caches, for statistics.  Caches are created during
+   initialization, so no lock is needed. */
+static struct list caches = LIST_INITIALIZER (caches);
+
+/* Returns the location of OBJECT's free pointer in cache C. */
+static void **
+free_ptr (struct kmem_cache *c, void *object)
+{
+  return (void **) ((uint8_t *) object + c->free_ofs);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes, called
+   NAME.  If CTOR is nonnull, it is run on each object before it
+   is first allocated.  Panics if memory is not available, since
+   caches are created during initialization. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("%s: out of memory creating cache", name);
+
+  c->name = name;
+  c->size = size;
+  c->ctor = ctor;
+  if (ctor == NULL)
+    {
+      c->free_ofs = 0;
+      c->stride = ROUND_UP (size > sizeof (void *) ? size : sizeof (void *),
+                            sizeof (void *));
+    }
+  else
+    {
+      c->free_ofs = ROUND_UP (size, sizeof (void *));
+      c->stride = c->free_ofs + sizeof (void *);
+    }
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->stride;
+  ASSERT (c->objs_per_slab > 0);
+
+  lock_init (&c->lock);
+  list_init (&c->slabs);
+  c->slab_cnt = c->empty_cnt = 0;
+  c->alloc_cnt = c->free_cnt = c->slabs_created = 0;
+  c->active = c->peak_active = 0;
+  list_push_back (&caches, &c->elem);
+  return c;
+}
+
+/* Obtains a new slab for cache C, constructs its objects, and
+   adds it to C's list of slabs.  Returns false if memory is not
+   available.  C's lock must be held. */
+static bool
+add_slab (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  uint8_t *object;
+  size_t i;
+
+  if (s == NULL)
+    return false;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free = NULL;
+  s->free_cnt = c->objs_per_slab;
+  object = (uint8_t *) (s + 1) + c->stride * c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      object -= c->stride;
+      if (c->ctor != NULL)
+        c->ctor (object);
+      *free_ptr (c, object) = s->free;
+      s->free = object;
+    }
+  list_push_back (&c->slabs, &s->elem);
+  c->slab_cnt++;
+  c->empty_cnt++;
+  c->slabs_created++;
+  return true;
+}
+
+/* Allocates and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *object;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->slabs) && !add_slab (c))
+    {
+      lock_release (&c->lock);
+      return NULL;
+    }
+
+  s = list_entry (list_front (&c->slabs), struct slab, elem);
+  if (s->free_cnt == c->objs_per_slab)
+    c->empty_cnt--;
+  object = s->free;
+  s->free = *free_ptr (c, object);
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+
+  c->alloc_cnt++;
+  if (++c->active > c->peak_active)
+    c->peak_active = c->active;
+  lock_release (&c->lock);
+  return object;
+}
+
+/* Returns OBJECT, which must have been allocated from cache C,
+   to C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *object)
+{
+  struct slab *s;
+
+  if (object == NULL)
+    return;
+
+  s = pg_round_down (object);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (((uint8_t *) object - (uint8_t *) (s + 1)) % c->stride == 0);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  if (c->ctor == NULL)
+    memset (object, 0xcc, c->size);
+#endif
+
+  lock_acquire (&c->lock);
+  *free_ptr (c, object) = s->free;
+  s->free = object;
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->slabs, &s->elem);
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      if (c->empty_cnt > 0)
+        {
+          /* Already have a free slab in reserve. */
+          c->slab_cnt--;
+          palloc_free_page (s);
+        }
+      else
+        {
+          list_push_back (&c->slabs, &s->elem);
+          c->empty_cnt++;
+        }
+    }
+  c->free_cnt++;
+  c->active--;
+  lock_release (&c->lock);
+}
+
+/* Returns the size of the block that malloc() would use for an
+   object of SIZE bytes. */
+static size_t
+malloc_size (size_t size)
+{
+  size_t block_size;
+
+  for (block_size = 16; block_size < size; block_size *= 2)
+    continue;
+  return block_size;
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+      printf ("%s cache: %zu-byte objects (%zu with malloc), %zu per slab, "
+              "%zu slabs\n",
+              c->name, c->stride, malloc_size (c->size), c->objs_per_slab,
+              c->slab_cnt);
+      printf ("  %lld allocs, %lld frees, %zu in use (peak %zu), "
+              "%lld slabs created\n",
+              c->alloc_cnt, c->free_cnt, c->active, c->peak_active,
+              c->slabs_created);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* A cache of fixed-size kernel objects. */
+struct kmem_cache;
+
+/* Object constructor.  Called on each object when the cache
+   first obtains memory for it, not on every allocation, so
+   objects must be freed in their constructed state. */
+typedef void kmem_ctor_func (void *object);
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
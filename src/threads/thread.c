@@ -605,6 +605,13 @@ init_thread (struct thread *t, const char *name, int priority)
   t->parent = NULL;
   t->executable = NULL;
   t->my_process = NULL;
+#ifdef VM
+  t->pages = NULL;
+  t->image = NULL;
+  t->user_esp = NULL;
+  list_init (&t->mmaps);
+  t->next_mapid = 0;
+#endif
 
   t->magic = THREAD_MAGIC;
 
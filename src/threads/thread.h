@@ -8,6 +8,9 @@
 #include "threads/fixed-point.h"
 #include "devices/timer.h"
 #include "filesys/directory.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -142,6 +145,22 @@ struct thread
     int return_status;                  /* Return status of this thread. */
     struct file *executable;            /* Executable file. */
 #endif
+
+#ifdef VM
+    /* Owned by vm/page.c and userprog/process.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *image;                 /* Executable that pages are
+                                           loaded from. */
+    uint8_t *user_esp;                  /* User stack pointer on entry
+                                           to the kernel. */
+    struct page_stream streams[PAGE_STREAM_CNT]; /* Recent faults in
+                                           file mappings, most recent
+                                           first. */
+
+    /* Owned by userprog/syscall.c. */
+    struct list mmaps;                  /* List of memory mappings. */
+    int next_mapid;                     /* Next mapping id to hand out. */
+#endif
   };
 
 /* Holds the child thread, the child's status, and an element the
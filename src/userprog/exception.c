@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,9 +152,32 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page if it belongs to the process but has not
+     been loaded yet, or grow the stack.  The kernel faults on user
+     addresses too, when a system call touches a user buffer; the
+     user's stack pointer was saved on entry to the system call,
+     since F->esp is then the kernel's. */
+  if (user)
+    thread_current ()->user_esp = f->esp;
+  if (not_present && is_user_vaddr (fault_addr) && page_in (fault_addr))
+    {
+      /* A write would fault again if the page came in read-only,
+         e.g. as the zero frame, so break the sharing now. */
+      if (!write || page_copy_on_write (fault_addr))
+        {
+          page_fault_around (fault_addr);
+          return;
+        }
+    }
+
+  /* A write to a read-only mapping of a writable page needs a
+     private copy of a frame shared copy-on-write. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_copy_on_write (fault_addr))
+    return;
+#endif
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
@@ -5,6 +5,7 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
@@ -156,6 +157,15 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Returns true if virtual page VPAGE is mapped in PD and the
+   mapping allows writes, false otherwise. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & PTE_P) != 0 && (*pte & PTE_W) != 0;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -214,6 +224,80 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
     }
 }
 
+/* Creates page tables in the initial page directory for the
+   PAGE_CNT kernel virtual pages starting at VADDR, with no pages
+   mapped, so that pages can later be mapped there with
+   pagedir_kernel_map().
+
+   Must be called before any other page directory is created.
+   pagedir_create() copies the initial page directory's kernel
+   entries, so every page directory then shares these page
+   tables, and a kernel mapping made in one is made in all. */
+void
+pagedir_kernel_reserve (void *vaddr, size_t page_cnt)
+{
+  uint8_t *page;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT (!is_user_vaddr (vaddr));
+
+  for (page = vaddr; page < (uint8_t *) vaddr + page_cnt * PGSIZE;
+       page += PGSIZE)
+    {
+      uint32_t *pde = init_page_dir + pd_no (page);
+      if (*pde == 0)
+        *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+    }
+}
+
+/* Returns the page table entry for kernel virtual address VADDR,
+   which must be in a range set up by pagedir_kernel_reserve(). */
+static uint32_t *
+kernel_pte (const void *vaddr)
+{
+  uint32_t *pde = init_page_dir + pd_no (vaddr);
+
+  ASSERT (!is_user_vaddr (vaddr));
+  ASSERT (*pde & PTE_P);
+  return pde_get_pt (*pde) + pt_no (vaddr);
+}
+
+/* Maps kernel virtual page VADDR, in a range set up by
+   pagedir_kernel_reserve(), to the frame identified by kernel
+   virtual address KPAGE, read/write, in every page directory.
+   VADDR must not already be mapped. */
+void
+pagedir_kernel_map (void *vaddr, void *kpage)
+{
+  uint32_t *pte = kernel_pte (vaddr);
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT ((*pte & PTE_P) == 0);
+  *pte = pte_create_kernel (kpage, true);
+}
+
+/* Unmaps kernel virtual page VADDR, which must have been mapped
+   with pagedir_kernel_map(), and returns the kernel virtual
+   address of the frame it was mapped to. */
+void *
+pagedir_kernel_unmap (void *vaddr)
+{
+  uint32_t *pte = kernel_pte (vaddr);
+  void *kpage;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT (*pte & PTE_P);
+  kpage = pte_get_page (*pte);
+  *pte = 0;
+
+  /* The mapping is shared by every page directory, so flush it
+     from the TLB by address rather than by reloading the active
+     page directory.  Other page directories are not in the TLB;
+     switching to one reloads CR3. */
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+  return kpage;
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -17,8 +17,12 @@
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
@@ -34,6 +38,32 @@ struct load
       was successful or not. */
   };
 
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+
+/* Passed by process_fork() to the child thread. */
+struct fork
+  {
+    struct thread *parent;    /* The forking process. */
+    struct intr_frame if_;    /* Parent's registers on entry to fork. */
+    bool fork_success;        /* Denotes whether the copy succeeded. */
+    struct semaphore s;       /* Semaphore for parent to be alerted when
+      the child is done copying the parent's address space. */
+  };
+#endif
+
+/* Cache of 'struct child_process'es. */
+static struct kmem_cache *child_process_cache;
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  child_process_cache = kmem_cache_create ("child_process",
+                                           sizeof (struct child_process),
+                                           NULL);
+}
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -94,7 +124,7 @@ process_execute (const char *file_name)
 
       /* Child inherits the working directory from its parent */
       child_thread->current_directory = thread_current ()->current_directory;
-      cp = malloc (sizeof (struct child_process));
+      cp = kmem_cache_alloc (child_process_cache);
       if (cp == NULL)
         {
           palloc_free_page (fn_copy2);
@@ -183,6 +213,120 @@ start_process (void *load_info)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Starts a new process that is a copy of the current one, whose
+   registers on entry to the system call are F.  The child's
+   address space shares the parent's frames copy-on-write, so
+   creating it costs time in proportion to the size of the page
+   table rather than of the memory in use.  The child returns 0
+   from fork.  Like exec, open file descriptors and memory
+   mappings are not inherited.  Returns the child's thread id, or
+   -1 if the child could not be created. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct fork fork_info;
+  struct child_process *cp;
+  struct thread *child_thread;
+  tid_t tid;
+
+  /* Allocate the child's record before creating it, so that
+     failing to do so leaves no child behind. */
+  cp = kmem_cache_alloc (child_process_cache);
+  if (cp == NULL)
+    return -1;
+
+  fork_info.parent = cur;
+  fork_info.if_ = *f;
+  fork_info.fork_success = false;
+  sema_init (&fork_info.s, 0);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &fork_info);
+  if (tid == TID_ERROR)
+    {
+      kmem_cache_free (child_process_cache, cp);
+      return -1;
+    }
+
+  child_thread = get_caller_child (tid);
+  if (child_thread == NULL)
+    {
+      /* The child uses FORK_INFO, on our stack, until it signals
+         that its copy is done. */
+      sema_down (&fork_info.s);
+      kmem_cache_free (child_process_cache, cp);
+      return -1;
+    }
+
+  /* Child inherits the working directory from its parent. */
+  child_thread->current_directory = cur->current_directory;
+  cp->child = child_thread;
+  cp->child->my_process = cp;
+  cp->child_tid = tid;
+  if (cur->executable != NULL)
+    {
+      /* Deny writes to executable. */
+      cp->child->executable = file_reopen (cur->executable);
+      if (cp->child->executable != NULL)
+        file_deny_write (cp->child->executable);
+    }
+
+  cp->status = -1;
+  cp->terminated = false;
+  cp->waited_on = false;
+  list_push_back (&cur->children, &cp->child_elem);
+
+  /* Waiting for the child to copy our address space. */
+  sema_down (&fork_info.s);
+  if (!fork_info.fork_success)
+    return -1;
+  return tid;
+}
+
+/* A thread function that copies the address space of the
+   process that forked it and starts it running, returning 0 from
+   the fork system call. */
+static void
+start_fork (void *fork_info)
+{
+  struct fork *info = (struct fork *) fork_info;
+  struct thread *parent = info->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  /* Allocate and activate page directory. */
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+  process_activate ();
+
+  if (!page_table_create ())
+    goto done;
+  cur->image = file_reopen (parent->image);
+  if (cur->image == NULL || !page_table_copy (parent))
+    goto done;
+  success = true;
+
+ done:
+  /* Whether the copy failed or succeeded, updates the semaphore to
+     inform the parent.  The parent's frame is only valid until
+     then. */
+  info->fork_success = success;
+  sema_up (&info->s);
+  if (!success)
+    {
+      cur->return_status = -1;
+      thread_exit ();
+    }
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* Returns number of spaces in string s */
 int
 num_spaces (char *s)
@@ -354,7 +498,7 @@ process_exit (void)
         }
     }
   else
-    free (cur->my_process);
+    kmem_cache_free (child_process_cache, cur->my_process);
 
   /* Update each of my children's parents to NULL and free that child
      if they have already been terminated. */
@@ -369,7 +513,7 @@ process_exit (void)
       cp = list_entry (e, struct child_process, child_elem);
       cp->child->parent = NULL;
       if (cp->terminated)
-        free (cp);
+        kmem_cache_free (child_process_cache, cp);
       e = next;
     }
 
@@ -378,6 +522,16 @@ process_exit (void)
     file_allow_write (cur->executable);
 
   lock_release (&exit_lock);
+#ifdef VM
+  /* Write back and release memory-mapped files, then the
+     supplemental page table, with its frames, and the executable
+     that its pages were loaded from. */
+  munmap_all (cur);
+  page_table_destroy ();
+  file_close (cur->image);
+  cur->image = NULL;
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -501,6 +655,12 @@ load (const char *file_name, void (**eip) (void), void **esp)
     goto done;
   process_activate ();
 
+#ifdef VM
+  /* Allocate supplemental page table. */
+  if (!page_table_create ())
+    goto done;
+#endif
+
   /* Open executable file. */
   file = filesys_open (t->current_directory, file_name);
   if (file == NULL)
@@ -592,13 +752,24 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
   /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Pages are read from the executable on demand, so keep it open
+     for as long as the process runs. */
+  if (success)
+    t->image = file;
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -657,6 +828,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here, and are read in when the process first touches
+   them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -667,6 +842,22 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0)
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (page_add_file (upage, file, ofs, page_read_bytes, writable) == NULL)
+        return false;
+
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
     {
@@ -702,6 +893,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -709,6 +901,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp)
 {
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  if (page_add_file (upage, NULL, 0, 0, true) == NULL
+      || !page_in (upage))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
 
@@ -722,8 +923,10 @@ setup_stack (void **esp)
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -743,3 +946,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
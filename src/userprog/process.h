@@ -3,7 +3,12 @@
 
 #include "threads/thread.h"
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
+#ifdef VM
+struct intr_frame;
+tid_t process_fork (const struct intr_frame *);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
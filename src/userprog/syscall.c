@@ -7,8 +7,10 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
 #include "filesys/file.h"
@@ -16,6 +18,9 @@
 #include "filesys/file.h"
 #include "filesys/directory.h"
 #include "filesys/inode.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Prototypes for system call functions and helper functions. */
 static void syscall_handler (struct intr_frame *);
@@ -37,15 +42,38 @@ static bool mkdir (const char *);
 static bool readdir (int, char *);
 static bool isdir (int);
 static int inumber (int);
+static int getdents (int, void *, unsigned);
+static bool rmtree (const char *);
+static bool blkstat (const char *, struct blkstat *);
+#ifdef VM
+static mapid_t mmap (int, void *);
+static void munmap (mapid_t);
+static void unmap (struct sys_mmap *);
+#endif
 static bool filename_ends_in_slash (const char *);
 static bool check_pointer (const void *, unsigned);
+#ifndef VM
+static bool check_writable (void *, unsigned);
+#endif
 static struct dir *get_last_dir (const char *, const char **);
 static struct sys_fd* get_fd_item (int);
 
 static int next_avail_fd;       /* Tracks the next available fd. */
 
+static struct kmem_cache *sys_fd_cache;   /* Cache of 'struct sys_fd's. */
+static struct kmem_cache *sys_file_cache; /* Cache of 'struct sys_file's. */
+
+/* Constructs SF_ in sys_file_cache.  A sys_file is freed once its
+   fd_list is empty, so the list needs initializing only once. */
+static void
+sys_file_ctor (void *sf_)
+{
+  struct sys_file *sf = sf_;
+  list_init (&sf->fd_list);
+}
+
 /* Initialize the system call interrupt, as well as the next available
-   file descriptor and the file lists. */
+   file descriptor, the file lists and their object caches. */
 void
 syscall_init (void)
 {
@@ -53,6 +81,9 @@ syscall_init (void)
   list_init (&opened_files);
   list_init (&used_fds);
   next_avail_fd = 2; /* 0 and 1 are reserved. */
+  sys_fd_cache = kmem_cache_create ("sys_fd", sizeof (struct sys_fd), NULL);
+  sys_file_cache = kmem_cache_create ("sys_file", sizeof (struct sys_file),
+                                      sys_file_ctor);
 }
 
 /* Takes the interrupt frame as an argument and traces the stack
@@ -62,6 +93,12 @@ syscall_init (void)
 static void
 syscall_handler (struct intr_frame *f)
 {
+#ifdef VM
+  /* Remember the user stack pointer, for stack growth in case we
+     fault on a user buffer. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
   /* If esp is a bad address, kill the process immediately. */
   if (!check_pointer ((const void *) (f->esp), 1))
     exit (-1);
@@ -78,20 +115,35 @@ syscall_handler (struct intr_frame *f)
   int arg1 = *(sp + 1);
   int arg2 = *(sp + 2);
   int arg3 = *(sp + 3);
+#ifdef VM
+  bool pinned = false;
+#endif
 
   /* Check that arg1 (file name for exec, create, remove, and open)
      are valid separate from the above check.  In the second check,
      arg2 is evaluated for the read and write functions. */
   if (syscall_num == SYS_EXEC || syscall_num == SYS_CREATE ||
-      syscall_num == SYS_REMOVE || syscall_num == SYS_OPEN)
+      syscall_num == SYS_REMOVE || syscall_num == SYS_OPEN ||
+      syscall_num == SYS_RMTREE || syscall_num == SYS_BLKSTAT)
     {
       if (!check_pointer ((const void *) arg1, 1))
         exit (-1);
     }
-  else if (syscall_num == SYS_READ || syscall_num == SYS_WRITE)
+  else if (syscall_num == SYS_READ || syscall_num == SYS_WRITE
+           || syscall_num == SYS_GETDENTS)
     {
       if (!check_pointer ((const void *) arg2, 1))
         exit (-1);
+#ifdef VM
+      /* Bring in and pin the whole buffer now, so that the file
+         system does not fault on it while holding its locks.  A
+         read stores into the buffer, so its pages must be
+         writable. */
+      pinned = true;
+      if (!page_pin_range ((const void *) arg2, arg3,
+                           syscall_num != SYS_WRITE))
+        exit (-1);
+#endif
     }
 
   switch (syscall_num)
@@ -150,10 +202,35 @@ syscall_handler (struct intr_frame *f)
       case SYS_INUMBER :
         f->eax = inumber (arg1);
         break;
+      case SYS_GETDENTS :
+        f->eax = getdents (arg1, (void *) arg2, arg3);
+        break;
+      case SYS_RMTREE :
+        f->eax = rmtree ((char *) arg1);
+        break;
+      case SYS_BLKSTAT :
+        f->eax = blkstat ((char *) arg1, (struct blkstat *) arg2);
+        break;
+#ifdef VM
+      case SYS_FORK :
+        f->eax = process_fork (f);
+        break;
+      case SYS_MMAP :
+        f->eax = mmap (arg1, (void *) arg2);
+        break;
+      case SYS_MUNMAP :
+        munmap (arg1);
+        break;
+#endif
       default :
         exit (-1);
         break;
     }
+
+#ifdef VM
+  if (pinned)
+    page_unpin_range ((const void *) arg2, arg3);
+#endif
 }
 
 /* Terminates Pintos. */
@@ -239,6 +316,55 @@ remove (const char *file)
   return success;
 }
 
+/* Deletes the file or directory, and if it is a directory, everything
+   beneath it.  Returns true if successful, false otherwise.  Like
+   remove, the root directory cannot be removed. */
+static bool
+rmtree (const char *dir)
+{
+  if (!strcmp (dir, "/"))
+    return false;
+  bool success;
+  const char *new_dir;
+  struct dir *last_dir = get_last_dir (dir, &new_dir);
+
+  if (!last_dir)
+    return false;
+  success = filesys_rmtree (last_dir, new_dir);
+
+  dir_close (last_dir);
+  return success;
+}
+
+/* Copies the statistics of the block device named DEVICE into
+   ST.  Returns true if successful, false if there is no such
+   device. */
+static bool
+blkstat (const char *device, struct blkstat *st)
+{
+  struct block *block;
+  struct blkstat stats;
+
+  block = block_get_by_name (device);
+  if (block == NULL)
+    return false;
+
+  /* Take the snapshot into kernel memory, then copy it out, so
+     that a bad ST faults with interrupts on, or not at all. */
+  block_get_stats (block, &stats);
+#ifdef VM
+  if (st == NULL || !page_pin_range (st, sizeof *st, true))
+    exit (-1);
+  *st = stats;
+  page_unpin_range (st, sizeof *st);
+#else
+  if (!check_writable (st, sizeof *st))
+    exit (-1);
+  *st = stats;
+#endif
+  return true;
+}
+
 /* Opens the file and returns a file descriptor.  If open fails,
    -1 is returned. */
 static int
@@ -276,7 +402,7 @@ open (const char *file)
 
   dir_close (last_dir);
 
-  struct sys_fd *fd = malloc (sizeof (struct sys_fd));
+  struct sys_fd *fd = kmem_cache_alloc (sys_fd_cache);
   if (!fd)
     exit (-1);
   fd->value = next_avail_fd++;
@@ -286,13 +412,12 @@ open (const char *file)
   /* If we have not opened it before, create a new entry. */
   if (!found)
     {
-      sf = malloc (sizeof (struct sys_file));
+      sf = kmem_cache_alloc (sys_file_cache);
       if (!sf)
         {
-          free (fd);
+          kmem_cache_free (sys_fd_cache, fd);
           exit (-1);
         }
-      list_init (&sf->fd_list);
       strlcpy (sf->name, file, strlen (sf->name));
     }
 
@@ -448,18 +573,127 @@ close (int fd)
   if (list_empty (&fd_instance->sys_file->fd_list))
     {
       list_remove (&fd_instance->sys_file->sys_file_elem);
-      free (fd_instance->sys_file);
+      kmem_cache_free (sys_file_cache, fd_instance->sys_file);
     }
   dir_close (fd_instance->dir);
-  free (fd_instance);
+  kmem_cache_free (sys_fd_cache, fd_instance);
+}
+
+#ifdef VM
+/* Maps the file open as 'fd' into consecutive pages starting at
+   'addr', which must be page-aligned.  The pages are read from the
+   file when first touched, and written back to it when unmapped
+   if they were modified.  Returns the mapping id, or MAP_FAILED if
+   the file is empty or the range is unusable. */
+static mapid_t
+mmap (int fd, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct sys_fd *fd_instance = get_fd_item (fd);
+  struct sys_mmap *m;
+  off_t length;
+  off_t ofs;
+
+  if (fd_instance == NULL || isdir (fd)
+      || addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->value = t->next_mapid++;
+  m->file = file_reopen (fd_instance->file);
+  m->base = addr;
+  m->page_cnt = 0;
+  list_push_front (&t->mmaps, &m->thread_mmap_elem);
+  if (m->file == NULL)
+    goto fail;
+
+  length = file_length (m->file);
+  if (length == 0)
+    goto fail;
+
+  /* Add a page for each part of the file, failing if any of them
+     would overlap an existing page. */
+  for (ofs = 0; ofs < length; ofs += PGSIZE)
+    {
+      uint8_t *upage = m->base + ofs;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      struct page *p;
+
+      if (!is_user_vaddr (upage) || page_lookup (upage) != NULL)
+        goto fail;
+      p = page_add_file (upage, m->file, ofs, read_bytes, true);
+      if (p == NULL)
+        goto fail;
+      p->private = false;
+      m->page_cnt++;
+    }
+  return m->value;
+
+ fail:
+  unmap (m);
+  return MAP_FAILED;
+}
+
+/* Unmaps the mapping 'mapping', writing back any pages that were
+   modified. */
+static void
+munmap (mapid_t mapping)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mmaps); e != list_end (&t->mmaps);
+       e = list_next (e))
+    {
+      struct sys_mmap *m = list_entry (e, struct sys_mmap, thread_mmap_elem);
+      if (m->value == mapping)
+        {
+          unmap (m);
+          return;
+        }
+    }
+
+  /* Not a mapping of this process. */
+  exit (-1);
 }
 
+/* Removes mapping M's pages from the address space and frees it. */
+static void
+unmap (struct sys_mmap *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  file_close (m->file);
+  list_remove (&m->thread_mmap_elem);
+  free (m);
+}
+
+/* Helper function to unmap all of a process's mappings when it
+   exits.  Must be called before its page table is destroyed. */
+void
+munmap_all (struct thread *t)
+{
+  while (!list_empty (&t->mmaps))
+    unmap (list_entry (list_front (&t->mmaps), struct sys_mmap,
+                       thread_mmap_elem));
+}
+#endif
+
 /* Function to check all pointers that are passed to system calls.
    Returns false if the pointer is found to be invalid, and true
    if the pointer is valid.  Bound cases are checked. */
 static bool
 check_pointer (const void *pointer, unsigned size)
 {
+#ifdef VM
+  /* Pages that have not been touched yet are valid too; they are
+     brought in here. */
+  return pointer != NULL && page_in_range (pointer, size, false);
+#else
   struct thread *t = thread_current ();
 
   if (pointer == NULL || is_kernel_vaddr (pointer) ||
@@ -471,8 +705,30 @@ check_pointer (const void *pointer, unsigned size)
     return false;
 
   return true;
+#endif
 }
 
+#ifndef VM
+/* Returns true if the SIZE bytes at user address POINTER are all
+   mapped writable in the current process, false otherwise.  A
+   write by the kernel to a read-only user page would fault in
+   kernel mode, which kills the kernel rather than the process. */
+static bool
+check_writable (void *pointer, unsigned size)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage;
+
+  if (!check_pointer (pointer, size))
+    return false;
+  for (upage = pg_round_down (pointer);
+       upage < (uint8_t *) pointer + size; upage += PGSIZE)
+    if (!pagedir_is_writable (t->pagedir, upage))
+      return false;
+  return true;
+}
+#endif
+
 /* Function to retrieve the sys_fd struct corresponding to a particular
    fd.  Returns NULL if the fd could not be located in any list member or
    if it was found but the calling process is not the owner. */
@@ -622,6 +878,27 @@ readdir (int fd, char *name)
     }
 }
 
+/* Fills buffer with as many of directory fd's remaining entries as fit in
+   size bytes, packed as struct dirent records that include each entry's
+   inode number and type.  Returns the number of bytes filled, 0 once no
+   entries are left, or -1 if fd is not a directory or size cannot hold
+   the next entry. */
+static int
+getdents (int fd, void *buffer, unsigned size)
+{
+  if (size == 0)
+    return -1;
+  if (!check_pointer (buffer, size))
+    exit (-1);
+
+  /* If it is not a directory, return -1. */
+  if (!isdir (fd))
+    return -1;
+
+  struct sys_fd *fd_instance = get_fd_item (fd);
+  return dir_getdents (fd_instance->dir, buffer, size);
+}
+
 /* Returns true if fd represents a directory, false if it represents an
    ordinary file. */
 static bool
@@ -40,6 +40,26 @@ struct sys_fd
                                              personal list of fds. */
   };
 
+#ifdef VM
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A file mapped into a process's address space by mmap.  The
+   mapping holds its own reference to the file, so that it
+   survives the fd being closed. */
+struct sys_mmap
+  {
+    mapid_t value;                        /* The mapping id. */
+    struct file *file;                    /* The mapped file. */
+    uint8_t *base;                        /* Start of the mapping. */
+    size_t page_cnt;                      /* Number of pages mapped. */
+    struct list_elem thread_mmap_elem;    /* List element for the thread's
+                                             personal list of mappings. */
+  };
+
+void munmap_all (struct thread *);
+#endif
+
 struct list opened_files;       /* Global list of opened files. */
 struct list used_fds;           /* Global list of used fds values. */
 
@@ -0,0 +1,173 @@
+#include "userprog/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Allocator for large kernel buffers that need not be physically
+   contiguous.
+
+   malloc() serves requests over 2 kB with palloc_get_multiple(),
+   which needs physically contiguous pages and so can fail when
+   the kernel pool is fragmented even though plenty of it is
+   free.  vmalloc() instead takes pages from the kernel pool one
+   at a time, wherever they are, and maps them at consecutive
+   addresses in a range of kernel virtual memory set aside for the
+   purpose above the mapping of physical memory.  The range's page
+   tables are created at startup and shared by every page
+   directory, so the mappings are visible in every process.
+
+   Each area is followed by an unmapped guard page, so that
+   running off its end faults instead of corrupting the next area.
+
+   Memory from vmalloc() is only virtually contiguous, so it must
+   not be handed to a device that transfers data by physical
+   address, nor to code that may pass it on to one, such as the
+   block layer or the file system.  That is why the free map,
+   which is written to disk through its file, is not allocated
+   here. */
+
+/* The vmalloc range: 16 MB just below the top of the 4 GB
+   address space, leaving room below it to map up to 1 GB - 32 MB
+   of physical memory. */
+#define VMALLOC_START ((uint8_t *) 0xfe000000)
+#define VMALLOC_PAGES 4096
+
+/* Pages of the vmalloc range in use, including guard pages. */
+static struct bitmap *used_pages;
+
+/* For the first page of each area, the number of pages in the
+   area, not counting its guard page. */
+static uint16_t *area_pages;
+
+/* Protects used_pages, area_pages, and the statistics. */
+static struct lock vmalloc_lock;
+
+/* Statistics. */
+static long long alloc_cnt;     /* Successful allocations. */
+static long long fail_cnt;      /* Failed allocations. */
+static size_t pages_in_use;     /* Pages mapped now. */
+static size_t peak_pages;       /* Maximum of pages_in_use. */
+
+static void unmap_pages (uint8_t *, size_t page_cnt);
+
+/* Reserves the vmalloc range.  Must be called after
+   paging_init() and before any page directory is created. */
+void
+vmalloc_init (void)
+{
+  if ((uint8_t *) ptov (init_ram_pages * PGSIZE) > VMALLOC_START)
+    PANIC ("too much memory for vmalloc range");
+
+  lock_init (&vmalloc_lock);
+  used_pages = bitmap_create (VMALLOC_PAGES);
+  area_pages = malloc (sizeof *area_pages * VMALLOC_PAGES);
+  if (used_pages == NULL || area_pages == NULL)
+    PANIC ("couldn't allocate vmalloc map");
+  pagedir_kernel_reserve (VMALLOC_START, VMALLOC_PAGES);
+}
+
+/* Obtains and returns a new block of at least SIZE bytes,
+   page-aligned and virtually but not necessarily physically
+   contiguous.  Returns a null pointer if not enough pages or
+   address space are available. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t first, i;
+  uint8_t *area;
+
+  if (page_cnt == 0)
+    return NULL;
+
+  /* Find address space for the area and its guard page. */
+  lock_acquire (&vmalloc_lock);
+  first = bitmap_scan_and_flip (used_pages, 0, page_cnt + 1, false);
+  if (first == BITMAP_ERROR)
+    {
+      fail_cnt++;
+      lock_release (&vmalloc_lock);
+      return NULL;
+    }
+  area_pages[first] = page_cnt;
+  lock_release (&vmalloc_lock);
+
+  /* Map a page from anywhere in the kernel pool at each address. */
+  area = VMALLOC_START + first * PGSIZE;
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *kpage = palloc_get_page (0);
+      if (kpage == NULL)
+        {
+          unmap_pages (area, i);
+          lock_acquire (&vmalloc_lock);
+          bitmap_set_multiple (used_pages, first, page_cnt + 1, false);
+          fail_cnt++;
+          lock_release (&vmalloc_lock);
+          return NULL;
+        }
+      pagedir_kernel_map (area + i * PGSIZE, kpage);
+    }
+
+  lock_acquire (&vmalloc_lock);
+  alloc_cnt++;
+  pages_in_use += page_cnt;
+  if (pages_in_use > peak_pages)
+    peak_pages = pages_in_use;
+  lock_release (&vmalloc_lock);
+  return area;
+}
+
+/* Frees block P, which must have been allocated with vmalloc(). */
+void
+vfree (void *p)
+{
+  size_t first, page_cnt;
+
+  if (p == NULL)
+    return;
+
+  ASSERT (pg_ofs (p) == 0);
+  ASSERT ((uint8_t *) p >= VMALLOC_START
+          && (uint8_t *) p < VMALLOC_START + VMALLOC_PAGES * PGSIZE);
+
+  first = ((uint8_t *) p - VMALLOC_START) / PGSIZE;
+  page_cnt = area_pages[first];
+  ASSERT (bitmap_all (used_pages, first, page_cnt + 1));
+
+  unmap_pages (p, page_cnt);
+
+  lock_acquire (&vmalloc_lock);
+  bitmap_set_multiple (used_pages, first, page_cnt + 1, false);
+  pages_in_use -= page_cnt;
+  lock_release (&vmalloc_lock);
+}
+
+/* Unmaps the PAGE_CNT pages starting at AREA and frees the pages
+   they were mapped to. */
+static void
+unmap_pages (uint8_t *area, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    palloc_free_page (pagedir_kernel_unmap (area + i * PGSIZE));
+}
+
+/* Prints vmalloc statistics. */
+void
+vmalloc_print_stats (void)
+{
+  printf ("vmalloc: %lld allocations, %lld failed, %zu pages in use "
+          "(peak %zu)\n",
+          alloc_cnt, fail_cnt, pages_in_use, peak_pages);
+}
@@ -0,0 +1,11 @@
+#ifndef USERPROG_VMALLOC_H
+#define USERPROG_VMALLOC_H
+
+#include <stddef.h>
+
+void vmalloc_init (void);
+void *vmalloc (size_t);
+void vfree (void *);
+void vmalloc_print_stats (void);
+
+#endif /* userprog/vmalloc.h */
@@ -0,0 +1,491 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* The frame table takes every page of the user pool at startup
+   and hands frames out to user pages.  When none is free, a frame
+   is reclaimed with the clock algorithm: the hand sweeps the
+   table, clearing the accessed bits of each frame's pages, and
+   evicts the first frame none of whose pages had been accessed.
+   Evicting a shared frame evicts every page in it.
+
+   A frame's lock is held while its pages are being read in or
+   written out, or its list of pages is changing, so that the
+   owners cannot use the pages while they are in transit.  The
+   clock sweep only tries its locks and skips frames that are
+   busy.
+
+   The text cache lets processes running the same executable share
+   its read-only pages.  It maps an inode and offset to the frame
+   that holds that page of the executable, for as long as any
+   process maps the frame.  A frame's lock must be held to add it
+   to or remove it from the cache, and is acquired before
+   text_lock.
+
+   Pages that are all zeros are not given frames of their own
+   until they are written: they all share the zero frame, which is
+   mapped read-only.  The zero frame is outside the user pool, so
+   the clock never evicts it. */
+
+/* Maximum number of frames evicted together. */
+#define FRAME_CLUSTER SWAP_CLUSTER
+
+static struct frame *frames;
+static size_t frame_cnt;
+
+/* Protects the clock hand and the assignment of free frames. */
+static struct lock scan_lock;
+static size_t hand;
+
+/* Frame of zeros shared by untouched zero-fill pages. */
+static struct frame zero_frame;
+
+/* Text cache. */
+static struct hash text_cache;
+static struct lock text_lock;
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+static void frame_text_remove (struct frame *);
+
+/* Initializes the frame table, taking all of the user pool. */
+void
+frame_init (void)
+{
+  void *base;
+
+  lock_init (&scan_lock);
+  lock_init (&text_lock);
+  hash_init (&text_cache, text_hash, text_less, NULL);
+
+  frames = malloc (sizeof *frames * init_ram_pages);
+  if (frames == NULL)
+    PANIC ("out of memory allocating page frames");
+
+  while ((base = palloc_get_page (PAL_USER)) != NULL)
+    {
+      struct frame *f = &frames[frame_cnt++];
+      lock_init (&f->lock);
+      f->base = base;
+      list_init (&f->pages);
+      f->page_cnt = 0;
+      f->inode = NULL;
+    }
+  printf ("frame: %zu user frames\n", frame_cnt);
+
+  lock_init (&zero_frame.lock);
+  zero_frame.base = palloc_get_page (PAL_ZERO);
+  if (zero_frame.base == NULL)
+    PANIC ("out of memory allocating zero frame");
+  list_init (&zero_frame.pages);
+  zero_frame.page_cnt = 0;
+  zero_frame.inode = NULL;
+}
+
+/* Returns true if any page in frame F, which must be locked, is
+   pinned. */
+static bool
+frame_pinned (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->pinned)
+      return true;
+  return false;
+}
+
+/* Returns true if any page in frame F, which must be locked, has
+   been accessed since the last call, and clears all of their
+   accessed bits. */
+static bool
+frame_accessed_recently (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_accessed_recently (list_entry (e, struct page, frame_elem)))
+      accessed = true;
+  return accessed;
+}
+
+/* Evicts every page from the CNT frames in VICTIMS, which must
+   be locked, writing the pages that go to swap in one batch.
+   Returns one of the frames that was emptied, still locked; the
+   others are unlocked, free for use.  Returns a null pointer if no
+   frame could be emptied because swap is full.  Pages that could
+   not be written out stay in their frames. */
+static struct frame *
+frame_evict (struct frame **victims, size_t cnt)
+{
+  struct swap_batch batch;
+  struct frame *freed = NULL;
+  size_t i;
+
+  swap_batch_init (&batch);
+  for (i = 0; i < cnt; i++)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&victims[i]->pages);
+           e != list_end (&victims[i]->pages); e = list_next (e))
+        page_out (list_entry (e, struct page, frame_elem), &batch);
+    }
+  swap_batch_write (&batch);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = victims[i];
+      struct list_elem *e, *next;
+
+      for (e = list_begin (&f->pages); e != list_end (&f->pages); e = next)
+        {
+          next = list_next (e);
+          if (page_out_done (list_entry (e, struct page, frame_elem)))
+            {
+              list_remove (e);
+              f->page_cnt--;
+            }
+        }
+
+      if (f->page_cnt == 0)
+        {
+          frame_text_remove (f);
+          if (freed == NULL)
+            {
+              freed = f;
+              continue;
+            }
+        }
+      lock_release (&f->lock);
+    }
+  return freed;
+}
+
+/* Makes page P the only page in frame F, which must be locked and
+   free. */
+static void
+frame_claim (struct frame *f, struct page *p)
+{
+  ASSERT (f->page_cnt == 0);
+
+  list_push_back (&f->pages, &p->frame_elem);
+  f->page_cnt = 1;
+}
+
+/* Tries to lock frame F without waiting.  A frame that the
+   current thread already holds counts as busy: page_copy_on_write()
+   keeps a shared frame locked while it allocates the frame to copy
+   it into, and must neither get that frame back nor evict it. */
+static bool
+frame_try_lock (struct frame *f)
+{
+  return !lock_held_by_current_thread (&f->lock)
+         && lock_try_acquire (&f->lock);
+}
+
+/* Finds a free frame, makes P its page, and returns it locked,
+   or returns a null pointer if there is no free frame.
+   scan_lock must be held. */
+static struct frame *
+find_free_frame (struct page *p)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&scan_lock));
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = &frames[i];
+      if (!frame_try_lock (f))
+        continue;
+      if (f->page_cnt == 0)
+        {
+          frame_claim (f, p);
+          return f;
+        }
+      lock_release (&f->lock);
+    }
+  return NULL;
+}
+
+/* Returns true if frame F, which must be locked, may be evicted
+   now, that is, if it holds pages but none of them is pinned or
+   was accessed recently. */
+static bool
+frame_evictable (struct frame *f)
+{
+  return (f->page_cnt > 0 && !frame_pinned (f)
+          && !frame_accessed_recently (f));
+}
+
+/* Tries to allocate a frame for page P and lock it, evicting
+   other pages if there is no free frame.  Returns the frame, or a
+   null pointer if every frame is busy or the pages to evict could
+   not be written out.
+
+   The clock stops at the first frame it can evict, then goes on
+   to collect up to FRAME_CLUSTER frames it can evict, so that
+   their pages are written to swap together and later allocations
+   find free frames without waiting for eviction. */
+static struct frame *
+try_frame_alloc_and_lock (struct page *p)
+{
+  struct frame *victims[FRAME_CLUSTER];
+  size_t victim_cnt = 0;
+  struct frame *f;
+  size_t i;
+
+  lock_acquire (&scan_lock);
+
+  f = find_free_frame (p);
+  if (f != NULL)
+    {
+      lock_release (&scan_lock);
+      return f;
+    }
+
+  /* No free frame.  Find frames to evict.  Two full sweeps are
+     enough to clear every accessed bit and come back around. */
+  for (i = 0; i < frame_cnt * 2 && victim_cnt < FRAME_CLUSTER; i++)
+    {
+      f = &frames[hand];
+      if (++hand >= frame_cnt)
+        hand = 0;
+
+      if (!frame_try_lock (f))
+        continue;
+
+      if (f->page_cnt == 0 && victim_cnt == 0)
+        {
+          frame_claim (f, p);
+          lock_release (&scan_lock);
+          return f;
+        }
+
+      if (frame_evictable (f))
+        victims[victim_cnt++] = f;
+      else if (victim_cnt > 0)
+        {
+          /* Only gather frames close to the first victim. */
+          lock_release (&f->lock);
+          break;
+        }
+      else
+        lock_release (&f->lock);
+    }
+  lock_release (&scan_lock);
+
+  if (victim_cnt == 0)
+    return NULL;
+  f = frame_evict (victims, victim_cnt);
+  if (f == NULL)
+    return NULL;
+  frame_claim (f, p);
+  return f;
+}
+
+/* Allocates a free frame for page P and locks it, without evicting
+   anything.  Returns the frame, or a null pointer if there is no
+   free frame.  For reading ahead, which is not worth evicting
+   pages for. */
+struct frame *
+frame_alloc_free_and_lock (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&scan_lock);
+  f = find_free_frame (p);
+  lock_release (&scan_lock);
+  return f;
+}
+
+/* Allocates a frame for page P and locks it, evicting another
+   page if necessary.  Returns the frame, or a null pointer if no
+   frame could be made available. */
+struct frame *
+frame_alloc_and_lock (struct page *p)
+{
+  size_t try;
+
+  for (try = 0; try < 3; try++)
+    {
+      struct frame *f = try_frame_alloc_and_lock (p);
+      if (f != NULL)
+        {
+          ASSERT (lock_held_by_current_thread (&f->lock));
+          return f;
+        }
+      timer_msleep (1000);
+    }
+  return NULL;
+}
+
+/* Adds page P to the zero frame and returns the frame, locked.
+   P must be all zeros. */
+struct frame *
+frame_zero_lock (struct page *p)
+{
+  lock_acquire (&zero_frame.lock);
+  frame_share (&zero_frame, p);
+  return &zero_frame;
+}
+
+/* Returns true if frame F, which must be locked, may hold pages
+   of more than one process, so that they must be copied on
+   write. */
+bool
+frame_is_shared (const struct frame *f)
+{
+  return f->page_cnt > 1 || f == &zero_frame;
+}
+
+/* Locks P's frame, if it has one, waiting for any transfer in
+   progress to finish.  If the page is evicted meanwhile, it no
+   longer has a frame on return and nothing is locked. */
+void
+frame_lock (struct page *p)
+{
+  struct frame *f = p->frame;
+
+  if (f != NULL)
+    {
+      lock_acquire (&f->lock);
+      if (f != p->frame)
+        {
+          lock_release (&f->lock);
+          ASSERT (p->frame == NULL);
+        }
+    }
+}
+
+/* Adds page P to frame F, which must be locked, so that the two
+   share the frame's contents. */
+void
+frame_share (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  list_push_back (&f->pages, &p->frame_elem);
+  f->page_cnt++;
+}
+
+/* Removes page P from frame F, which must be locked, and unlocks
+   F.  Once its last page is removed, the frame is free for use by
+   other pages and its contents are discarded. */
+void
+frame_release (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->page_cnt > 0);
+
+  list_remove (&p->frame_elem);
+  f->page_cnt--;
+  if (f->page_cnt == 0)
+    frame_text_remove (f);
+  lock_release (&f->lock);
+}
+
+/* Looks in the text cache for the frame holding the page at
+   offset OFS in the executable whose inode is INODE.  If there is
+   one, adds page P to it and returns it locked.  Otherwise, or if
+   the frame is busy, returns a null pointer, and the caller should
+   read the page into a frame of its own. */
+struct frame *
+frame_text_lookup (struct inode *inode, off_t ofs, struct page *p)
+{
+  struct frame key;
+  struct hash_elem *e;
+  struct frame *f = NULL;
+
+  key.inode = inode;
+  key.ofs = ofs;
+
+  lock_acquire (&text_lock);
+  e = hash_find (&text_cache, &key.text_elem);
+  if (e != NULL)
+    {
+      /* The frame lock is acquired before text_lock, so we may
+         only try it here. */
+      f = hash_entry (e, struct frame, text_elem);
+      if (lock_try_acquire (&f->lock))
+        frame_share (f, p);
+      else
+        f = NULL;
+    }
+  lock_release (&text_lock);
+  return f;
+}
+
+/* Publishes frame F, which must be locked, in the text cache as
+   holding the page at offset OFS in the executable whose inode is
+   INODE.  If another frame already holds that page, F stays
+   private. */
+void
+frame_text_publish (struct frame *f, struct inode *inode, off_t ofs)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->inode == NULL);
+
+  f->inode = inode;
+  f->ofs = ofs;
+  lock_acquire (&text_lock);
+  if (hash_insert (&text_cache, &f->text_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&text_lock);
+}
+
+/* Removes frame F, which must be locked, from the text cache, if
+   it is there, once it no longer holds any pages. */
+static void
+frame_text_remove (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (f->inode != NULL)
+    {
+      lock_acquire (&text_lock);
+      hash_delete (&text_cache, &f->text_elem);
+      lock_release (&text_lock);
+      f->inode = NULL;
+    }
+}
+
+/* Returns a hash value for the page that frame F holds. */
+static unsigned
+text_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, text_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if the page held by frame A precedes the one held
+   by frame B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, text_elem);
+  const struct frame *b = hash_entry (b_, struct frame, text_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* Unlocks frame F, allowing it to be evicted. */
+void
+frame_unlock (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
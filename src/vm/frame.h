@@ -0,0 +1,45 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct page;
+
+/* A physical frame of user memory.  A frame may be shared
+   copy-on-write by several pages, e.g. after fork(), in which
+   case it is mapped read-only in all of them. */
+struct frame
+  {
+    struct lock lock;           /* Held while pages are moved in or out. */
+    void *base;                 /* Kernel virtual address. */
+    struct list pages;          /* Pages held in frame. */
+    size_t page_cnt;            /* Number of pages; 0 if free. */
+
+    /* A frame holding a read-only page of an executable is
+       published in the text cache, so that other processes
+       running it can map the same frame. */
+    struct inode *inode;        /* Executable's inode, or null. */
+    off_t ofs;                  /* Offset of page in executable. */
+    struct hash_elem text_elem; /* Element in text cache. */
+  };
+
+void frame_init (void);
+
+struct frame *frame_alloc_and_lock (struct page *);
+struct frame *frame_alloc_free_and_lock (struct page *);
+struct frame *frame_zero_lock (struct page *);
+bool frame_is_shared (const struct frame *);
+void frame_lock (struct page *);
+void frame_unlock (struct frame *);
+void frame_share (struct frame *, struct page *);
+void frame_release (struct frame *, struct page *);
+
+struct frame *frame_text_lookup (struct inode *, off_t, struct page *);
+void frame_text_publish (struct frame *, struct inode *, off_t);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,796 @@
+#include "vm/page.h"
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Each process has a supplemental page table, a hash table of
+   struct page keyed by user virtual address.  A process's pages
+   are added to the table when its address space is laid out, but
+   no memory is allocated for them until they are first accessed:
+   the page fault handler then calls page_in() to allocate a frame,
+   fill it from the executable or from swap, and map it.  A page
+   that is all zeros instead maps the shared zero frame read-only,
+   and gets a frame of its own on its first write, like a page
+   shared copy-on-write.  When frames run short, the frame table
+   calls page_out() to evict a page: a clean page read from a file
+   is simply dropped, since it can be read again, and any other
+   page goes to swap.
+
+   The stack starts out as a single page and grows on demand: an
+   access to an unmapped address just below the stack pointer, and
+   within page_stack_max bytes of the top of user memory, adds a
+   new zero page.
+
+   Read-only pages of the executable are shared with other
+   processes running it through the frame table's text cache.
+
+   A fault in a file mapping also maps the pages that follow it in
+   the file, if the process has been faulting through the mapping
+   in order.  See page_fault_around().
+
+   Only the owning process adds and removes pages, so the table
+   itself needs no locking.  A page's residency is protected by
+   its frame's lock; see frame.c. */
+
+/* Maximum size of a process's stack, in bytes.  Set with the
+   kernel's -stack option. */
+size_t page_stack_max = 8 * 1024 * 1024;
+
+/* Maximum number of pages mapped at a fault in a file mapping,
+   including the faulting page.  Set with the kernel's
+   -fault-around option; 1 disables fault-around. */
+unsigned page_around_max = 16;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static void page_release (struct page *);
+static bool do_page_in (struct page *);
+static bool page_map_writable (struct page *);
+
+/* Creates the current process's supplemental page table.
+   Returns true if successful, false on failure. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Destroys the current process's supplemental page table,
+   releasing its frames and swap slots.  Must be called before the
+   page directory is destroyed, which would otherwise free the
+   frames that are still mapped in it. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages == NULL)
+    return;
+  hash_destroy (t->pages, page_destroy);
+  free (t->pages);
+  t->pages = NULL;
+}
+
+/* Copies the supplemental page table of PARENT, which must be
+   blocked, into the current process, whose table must be empty,
+   for fork().  Resident pages are not copied: their frames are
+   shared copy-on-write and mapped read-only in both processes.
+   Pages in swap are read in first, so that they can be shared
+   too.  Pages of memory-mapped files are not inherited.  Returns
+   true if successful, false if memory is exhausted. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *q;
+      struct frame *f;
+      bool success;
+
+      if (!p->private)
+        continue;
+
+      q = page_add_file (p->upage, NULL, 0, 0, p->writable);
+      if (q == NULL)
+        return false;
+
+      frame_lock (p);
+      if (p->frame == NULL && p->sector != SWAP_NONE && !do_page_in (p))
+        return false;
+
+      /* A page that was modified can no longer be read back from
+         the executable. */
+      if (p->frame != NULL && p->file != NULL
+          && pagedir_is_dirty (p->pagedir, p->upage))
+        p->file = NULL;
+
+      if (p->file != NULL)
+        {
+          ASSERT (p->file == parent->image);
+          q->file = t->image;
+          q->file_ofs = p->file_ofs;
+          q->read_bytes = p->read_bytes;
+        }
+
+      f = p->frame;
+      if (f == NULL)
+        continue;
+
+      /* Unmap the parent's writable page, so that it faults and is
+         remapped read-only the next time it touches it. */
+      if (p->writable)
+        pagedir_clear_page (p->pagedir, p->upage);
+      frame_share (f, q);
+      q->frame = f;
+      success = pagedir_set_page (t->pagedir, q->upage, f->base, false);
+      frame_unlock (f);
+      if (!success)
+        return false;
+    }
+  return true;
+}
+
+/* Returns the page containing user virtual address ADDR in the
+   current process's supplemental page table, or a null pointer
+   if there is none. */
+struct page *
+page_lookup (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+  p.upage = pg_round_down (addr);
+  e = hash_find (t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns the page containing user virtual address ADDR, like
+   page_lookup(), but if there is none and ADDR looks like an
+   access to the current process's stack, adds a zero page there
+   to grow the stack.  PUSHA may touch memory up to 32 bytes below
+   the stack pointer before moving it, so such addresses count as
+   stack accesses too. */
+static struct page *
+page_for_addr (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (addr);
+
+  if (p == NULL
+      && (uint8_t *) addr >= (uint8_t *) PHYS_BASE - page_stack_max
+      && (uint8_t *) addr >= t->user_esp - 32)
+    p = page_add_file (pg_round_down (addr), NULL, 0, 0, true);
+  return p;
+}
+
+/* Adds a page at user virtual address UPAGE to the current
+   process's supplemental page table.  The page will initially
+   hold READ_BYTES bytes read from FILE at offset OFS, followed by
+   zeros; FILE may be null if READ_BYTES is 0.  The page is
+   private; callers mapping a file set `private' to false.
+   Returns the new page, or a null pointer if memory is exhausted
+   or UPAGE is already in the table. */
+struct page *
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+  ASSERT (file != NULL || read_bytes == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->pagedir = t->pagedir;
+  p->writable = writable;
+  p->pinned = false;
+  p->private = true;
+  p->frame = NULL;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->sector = SWAP_NONE;
+
+  if (hash_insert (t->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Removes the page at user virtual address UPAGE from the
+   current process's supplemental page table, writing it back to
+   its file if it maps one and was modified. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  ASSERT (p != NULL);
+  hash_delete (thread_current ()->pages, &p->hash_elem);
+  page_release (p);
+}
+
+/* Returns true if page P, whose frame the caller must have
+   locked, may be mapped writable.  A shared frame is mapped
+   read-only so that the first write to it faults and is given a
+   copy. */
+static bool
+page_map_writable (struct page *p)
+{
+  return p->writable && !frame_is_shared (p->frame);
+}
+
+/* Allocates a frame for page P, which must be in swap, and reads
+   it in, returning true with the frame locked if successful, false
+   on failure.  Other pages of the same process that were written
+   to swap along with P are read ahead in the same batch and
+   mapped, as long as there are free frames for them, since they
+   are likely to be needed soon too. */
+static bool
+page_swap_in (struct page *p)
+{
+  struct swap_batch batch;
+  struct page *near[SWAP_CLUSTER - 1];
+  struct frame *f;
+  size_t near_cnt, i;
+
+  f = frame_alloc_and_lock (p);
+  if (f == NULL)
+    return false;
+
+  swap_batch_init (&batch);
+  swap_batch_add (&batch, p, f->base);
+  near_cnt = swap_neighbors (p->sector, p->pagedir, near,
+                             SWAP_CLUSTER - 1);
+  for (i = 0; i < near_cnt; i++)
+    {
+      struct frame *g = frame_alloc_free_and_lock (near[i]);
+      if (g == NULL)
+        break;
+      near[i]->frame = g;
+      swap_batch_add (&batch, near[i], g->base);
+    }
+  near_cnt = i;
+  swap_batch_read (&batch);
+
+  for (i = 0; i < near_cnt; i++)
+    {
+      struct page *q = near[i];
+      pagedir_set_page (q->pagedir, q->upage, q->frame->base,
+                        page_map_writable (q));
+      frame_unlock (q->frame);
+    }
+
+  p->frame = f;
+  return true;
+}
+
+/* Returns true if page P is a read-only page of the executable,
+   which processes running the same executable can share.  A
+   partial page at the end of a segment is left out, because a
+   following segment may start in the same page of the file with
+   different contents. */
+static bool
+page_is_text (const struct page *p)
+{
+  return p->file != NULL && p->private && !p->writable
+         && p->read_bytes == PGSIZE;
+}
+
+/* Allocates a frame for page P, which must not have one, and
+   fills it with the page's contents.  Returns true with the frame
+   locked if successful, false on failure. */
+static bool
+do_page_in (struct page *p)
+{
+  struct frame *f;
+
+  if (p->sector != SWAP_NONE)
+    return page_swap_in (p);
+
+  /* A page that is all zeros maps the zero frame until it is
+     written. */
+  if (p->file == NULL)
+    {
+      p->frame = frame_zero_lock (p);
+      return true;
+    }
+
+  /* A read-only page of the executable may already be in memory
+     for another process running it. */
+  if (page_is_text (p))
+    {
+      f = frame_text_lookup (file_get_inode (p->file), p->file_ofs, p);
+      if (f != NULL)
+        {
+          p->frame = f;
+          return true;
+        }
+    }
+
+  f = frame_alloc_and_lock (p);
+  if (f == NULL)
+    return false;
+
+  if (file_read_at (p->file, f->base, p->read_bytes, p->file_ofs)
+      != (off_t) p->read_bytes)
+    {
+      frame_release (f, p);
+      return false;
+    }
+  memset ((uint8_t *) f->base + p->read_bytes, 0,
+          PGSIZE - p->read_bytes);
+
+  if (page_is_text (p))
+    frame_text_publish (f, file_get_inode (p->file), p->file_ofs);
+  p->frame = f;
+  return true;
+}
+
+/* Makes the page containing user virtual address ADDR resident
+   and mapped in the current process, if it is in its supplemental
+   page table or is a new stack page.  Returns true if successful,
+   false if there is no such page or it could not be brought in. */
+bool
+page_in (const void *addr)
+{
+  struct page *p = page_for_addr (addr);
+  bool success = true;
+
+  if (p == NULL)
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL && !do_page_in (p))
+    return false;
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (pagedir_get_page (p->pagedir, p->upage) == NULL)
+    success = pagedir_set_page (p->pagedir, p->upage, p->frame->base,
+                                page_map_writable (p));
+  frame_unlock (p->frame);
+  return success;
+}
+
+/* Returns the stream in the current process for FILE, moving it
+   to the front of the process's streams.  If there is none, the
+   least recently used stream is reset and reused for FILE. */
+static struct page_stream *
+get_stream (struct file *file)
+{
+  struct page_stream *streams = thread_current ()->streams;
+  struct page_stream s;
+  int i;
+
+  for (i = 0; i < PAGE_STREAM_CNT - 1; i++)
+    if (streams[i].file == file)
+      break;
+
+  s = streams[i];
+  if (s.file != file)
+    {
+      s.file = file;
+      s.next = NULL;
+      s.window = 1;
+    }
+  memmove (streams + 1, streams, i * sizeof *streams);
+  streams[0] = s;
+  return &streams[0];
+}
+
+/* Maximum number of pages read by fault-around in one batch. */
+#define AROUND_BATCH 16
+
+/* Reads the CNT pages PAGES[], which follow one another in the
+   same file and have been given locked frames, with a single
+   batch of reads, then maps and unlocks them.  Returns true if
+   successful.  On failure, the pages that were not mapped are
+   left without frames, and false is returned. */
+static bool
+read_around (struct page *pages[], size_t cnt)
+{
+  void *kpages[AROUND_BATCH];
+  struct page *first = pages[0];
+  off_t size = (off_t) (cnt - 1) * PGSIZE + pages[cnt - 1]->read_bytes;
+  bool success;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    kpages[i] = pages[i]->frame->base;
+  success = file_read_pages (first->file, kpages, size, first->file_ofs)
+            == size;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *q = pages[i];
+      struct frame *f = q->frame;
+
+      if (success)
+        {
+          memset ((uint8_t *) f->base + q->read_bytes, 0,
+                  PGSIZE - q->read_bytes);
+          if (page_is_text (q))
+            frame_text_publish (f, file_get_inode (q->file), q->file_ofs);
+          success = pagedir_set_page (q->pagedir, q->upage, f->base,
+                                      page_map_writable (q));
+        }
+      if (success)
+        frame_unlock (f);
+      else
+        {
+          q->frame = NULL;
+          frame_release (f, q);
+        }
+    }
+  return success;
+}
+
+/* Called after a fault on user virtual address ADDR in the
+   current process has been handled, to map the pages that follow
+   it in the same file, so that a process reading through a file
+   mapping or its code takes one fault per window of pages rather
+   than one per page.  The window doubles, up to page_around_max
+   pages, each time the process faults on the page just past the
+   previous window, and drops back to 1 page on any other fault in
+   the mapping, so that random access does not read pages that
+   will not be used.  Only pages that are still in the file, and
+   so can be read sequentially, are mapped, and only while there
+   are free frames for them: reading ahead is not worth evicting
+   anything for.  Up to AROUND_BATCH of them at a time are read
+   with one batch of disk requests; see file_read_pages(). */
+void
+page_fault_around (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+  struct page *batch[AROUND_BATCH];
+  struct page_stream *s;
+  size_t cnt = 0;
+  unsigned i;
+
+  if (p == NULL || p->file == NULL)
+    return;
+
+  s = get_stream (p->file);
+  if (s->next == p->upage)
+    s->window = s->window * 2 < page_around_max ? s->window * 2
+                                                : page_around_max;
+  else
+    s->window = 1;
+
+  for (i = 1; i < s->window; i++)
+    {
+      uint8_t *upage = (uint8_t *) p->upage + i * PGSIZE;
+      struct page *q;
+      struct frame *f;
+
+      if (!is_user_vaddr (upage))
+        break;
+      q = page_lookup (upage);
+      if (q == NULL || q->file != p->file || q->frame != NULL
+          || q->sector != SWAP_NONE
+          || q->file_ofs != p->file_ofs + (off_t) (i * PGSIZE))
+        break;
+
+      /* Another process running the executable may already have
+         the page in memory.  The batch must stay contiguous in
+         the file, so read it first. */
+      if (page_is_text (q))
+        {
+          f = frame_text_lookup (file_get_inode (q->file),
+                                 q->file_ofs, q);
+          if (f != NULL)
+            {
+              bool success;
+
+              q->frame = f;
+              success = pagedir_set_page (q->pagedir, q->upage, f->base,
+                                          page_map_writable (q));
+              frame_unlock (f);
+              if (!success || (cnt > 0 && !read_around (batch, cnt)))
+                {
+                  cnt = 0;
+                  break;
+                }
+              cnt = 0;
+              continue;
+            }
+        }
+
+      f = frame_alloc_free_and_lock (q);
+      if (f == NULL)
+        break;
+      q->frame = f;
+      batch[cnt++] = q;
+      if (cnt == AROUND_BATCH)
+        {
+          bool success = read_around (batch, cnt);
+          cnt = 0;
+          if (!success)
+            break;
+        }
+    }
+  if (cnt > 0 && !read_around (batch, cnt))
+    i -= cnt;
+  s->next = (uint8_t *) p->upage + i * PGSIZE;
+}
+
+/* Handles a write to the page containing user virtual address
+   ADDR that faulted because the page is mapped read-only although
+   it is writable, which means that its frame is or was shared
+   copy-on-write or is the zero frame.  Gives the page a private
+   copy of the frame, if it is still shared, and maps it
+   writable, keeping its dirty bit.  Returns true if successful,
+   false if ADDR is not in a writable page or memory is
+   exhausted. */
+bool
+page_copy_on_write (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+  struct frame *shared;
+  struct frame *f;
+  bool dirty;
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL && !do_page_in (p))
+    return false;
+  shared = p->frame;
+
+  /* A private frame that is already mapped writable needs
+     nothing, and remapping it would lose its dirty bit. */
+  if (!frame_is_shared (shared)
+      && pagedir_is_writable (p->pagedir, p->upage))
+    {
+      frame_unlock (shared);
+      return true;
+    }
+
+  dirty = pagedir_is_dirty (p->pagedir, p->upage);
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (frame_is_shared (shared))
+    {
+      /* Leave the shared frame, keeping it locked so that it
+         cannot be evicted while we copy it.  The frame scans skip
+         frames that we hold, so allocating cannot trip over it. */
+      list_remove (&p->frame_elem);
+      shared->page_cnt--;
+      p->frame = NULL;
+
+      f = frame_alloc_and_lock (p);
+      if (f == NULL)
+        {
+          frame_share (shared, p);
+          p->frame = shared;
+          frame_unlock (shared);
+          return false;
+        }
+      memcpy (f->base, shared->base, PGSIZE);
+      frame_unlock (shared);
+      p->frame = f;
+    }
+  else
+    f = shared;
+
+  ASSERT (!frame_is_shared (f));
+  if (!pagedir_set_page (p->pagedir, p->upage, f->base, true))
+    {
+      frame_unlock (f);
+      return false;
+    }
+  pagedir_set_dirty (p->pagedir, p->upage, dirty);
+  frame_unlock (f);
+  return true;
+}
+
+/* Starts evicting page P from its frame, which the caller must
+   have locked.  The page is unmapped first, so that its process
+   faults on it rather than modifying it behind our back.  A page
+   of a memory-mapped file is written back to the file if it is
+   dirty, and a clean page that came from a file is dropped; either
+   way, it leaves its frame now.  Otherwise, the page is added to
+   BATCH, to be written to swap with the other pages evicted along
+   with it, and keeps its frame until page_out_done() is called
+   after the batch is written. */
+void
+page_out (struct page *p, struct swap_batch *batch)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  pagedir_clear_page (p->pagedir, p->upage);
+  if (p->file != NULL && !p->private)
+    {
+      if (pagedir_is_dirty (p->pagedir, p->upage))
+        file_write_at (p->file, p->frame->base, p->read_bytes,
+                       p->file_ofs);
+      p->frame = NULL;
+    }
+  else if (p->file != NULL && !pagedir_is_dirty (p->pagedir, p->upage))
+    p->frame = NULL;
+  else
+    swap_batch_add (batch, p, p->frame->base);
+}
+
+/* Finishes evicting page P, once the batch passed to page_out()
+   has been written.  Returns true if P has left its frame, false
+   if swap was full, in which case P keeps its frame.  The caller
+   removes P from the frame's list of pages if it left. */
+bool
+page_out_done (struct page *p)
+{
+  if (p->frame == NULL)
+    return true;
+  if (p->sector == SWAP_NONE)
+    return false;
+
+  /* From now on the page's contents live in swap, even if it came
+     from a file originally. */
+  p->file = NULL;
+  p->frame = NULL;
+  return true;
+}
+
+/* Returns true if page P, whose frame the caller must have locked,
+   has been accessed since the last call, and clears its accessed
+   bit. */
+bool
+page_accessed_recently (struct page *p)
+{
+  bool accessed;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  accessed = pagedir_is_accessed (p->pagedir, p->upage);
+  if (accessed)
+    pagedir_set_accessed (p->pagedir, p->upage, false);
+  return accessed;
+}
+
+/* Makes every page in the SIZE bytes of user memory at UADDR
+   resident in the current process, pinning each one if PIN is
+   true.  If WRITE is true, the pages must also be writable.
+   Returns true if successful, false if part of the range is not
+   valid user memory. */
+static bool
+load_range (const void *uaddr, unsigned size, bool write, bool pin)
+{
+  const uint8_t *addr = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+
+  if (size == 0)
+    return true;
+  if (end < (const uint8_t *) uaddr || !is_user_vaddr (end - 1))
+    return false;
+
+  for (; addr < end; addr += PGSIZE)
+    {
+      struct page *p = page_for_addr (addr);
+
+      if (p == NULL || (write && !p->writable))
+        return false;
+      if (pin)
+        p->pinned = true;
+      if (!page_in (addr) || (write && !page_copy_on_write (addr)))
+        return false;
+    }
+  return true;
+}
+
+/* Makes every page in the SIZE bytes of user memory at UADDR
+   resident in the current process.  If WRITE is true, the pages
+   must also be writable.  Returns true if successful, false if
+   part of the range is not valid user memory. */
+bool
+page_in_range (const void *uaddr, unsigned size, bool write)
+{
+  return load_range (uaddr, size, write, false);
+}
+
+/* Like page_in_range(), but also pins the pages in memory, so
+   that the kernel can access them without faulting, e.g. while it
+   holds file system locks.  The pages must be unpinned with
+   page_unpin_range() afterward, even on failure. */
+bool
+page_pin_range (const void *uaddr, unsigned size, bool write)
+{
+  return load_range (uaddr, size, write, true);
+}
+
+/* Allows the pages in the SIZE bytes of user memory at UADDR to
+   be evicted again. */
+void
+page_unpin_range (const void *uaddr, unsigned size)
+{
+  const uint8_t *addr = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+
+  if (size == 0 || end < (const uint8_t *) uaddr || !is_user_vaddr (end - 1))
+    return;
+
+  for (; addr < end; addr += PGSIZE)
+    {
+      struct page *p = page_lookup (addr);
+      if (p != NULL)
+        p->pinned = false;
+    }
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Frees page P along with its frame and swap slot.  If P maps a
+   file and was modified, its contents are written back first. */
+static void
+page_release (struct page *p)
+{
+  frame_lock (p);
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->pagedir, p->upage);
+      if (p->file != NULL && !p->private
+          && pagedir_is_dirty (p->pagedir, p->upage))
+        file_write_at (p->file, p->frame->base, p->read_bytes,
+                       p->file_ofs);
+      frame_release (p->frame, p);
+    }
+  if (p->sector != SWAP_NONE)
+    swap_free (p->sector);
+  free (p);
+}
+
+/* Frees page P, for hash_destroy(). */
+static void
+page_destroy (struct hash_elem *p_, void *aux UNUSED)
+{
+  page_release (hash_entry (p_, struct page, hash_elem));
+}
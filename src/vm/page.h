@@ -0,0 +1,81 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* A page of a process's user virtual memory, as recorded in its
+   supplemental page table.  Besides the frame that holds the page
+   while it is resident, it says where the page's contents are
+   when it is not: in a file, in swap, or nowhere because it is
+   all zeros.  Pages of a memory-mapped file are not private:
+   changes to them are written back to the file. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    uint32_t *pagedir;          /* Owning process's page directory. */
+    bool writable;              /* Writable by the process? */
+    bool pinned;                /* Must not be evicted? */
+    bool private;               /* False to write dirty contents back
+                                   to FILE, true to write to swap. */
+    struct frame *frame;        /* Frame holding the page, or null. */
+
+    /* Contents when not resident: READ_BYTES bytes from FILE at
+       FILE_OFS followed by zeros, or the swap slot starting at
+       SECTOR.  FILE is null and SECTOR is SWAP_NONE for a page
+       that is all zeros. */
+    struct file *file;          /* File to read from, or null. */
+    off_t file_ofs;             /* Offset in FILE. */
+    uint32_t read_bytes;        /* Bytes to read from FILE. */
+    block_sector_t sector;      /* First swap sector, or SWAP_NONE. */
+
+    struct hash_elem hash_elem; /* Element in thread's `pages'. */
+    struct list_elem frame_elem; /* Element in frame's `pages'. */
+  };
+
+/* Number of file mappings per process whose faults are tracked
+   for fault-around. */
+#define PAGE_STREAM_CNT 4
+
+/* Recent page faults in one file mapping of a process.  Faults
+   that follow on from the previous one widen the window of pages
+   mapped around the next fault; any other fault narrows it. */
+struct page_stream
+  {
+    struct file *file;          /* File faulted on, or null. */
+    uint8_t *next;              /* Page expected next if sequential. */
+    unsigned window;            /* Pages mapped at the last fault. */
+  };
+
+/* Maximum size of a process's stack, in bytes. */
+extern size_t page_stack_max;
+
+/* Maximum number of pages mapped at a fault in a file mapping. */
+extern unsigned page_around_max;
+
+struct thread;
+
+bool page_table_create (void);
+void page_table_destroy (void);
+bool page_table_copy (struct thread *parent);
+
+struct page *page_lookup (const void *);
+struct page *page_add_file (void *upage, struct file *, off_t,
+                            uint32_t read_bytes, bool writable);
+void page_remove (void *upage);
+bool page_in (const void *);
+void page_fault_around (const void *);
+bool page_copy_on_write (const void *);
+struct swap_batch;
+void page_out (struct page *, struct swap_batch *);
+bool page_out_done (struct page *);
+bool page_accessed_recently (struct page *);
+
+bool page_in_range (const void *, unsigned size, bool write);
+bool page_pin_range (const void *, unsigned size, bool write);
+void page_unpin_range (const void *, unsigned size);
+
+#endif /* vm/page.h */
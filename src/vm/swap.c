@@ -0,0 +1,282 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "vm/page.h"
+#include "vm/zswap.h"
+
+/* The swap device is divided into page-sized slots, each
+   SWAP_SLOT_SECTORS sectors long.  A bitmap records which slots
+   are in use.  Slots are identified by their first sector.
+
+   Pages are written to swap in batches: the pages evicted together
+   get a run of consecutive slots, if there is one, and their
+   writes are submitted together so that the block layer merges
+   them into one large transfer.  Each slot remembers the page it
+   holds and the run it was written in, so that when one of them
+   is faulted back in, the rest of the run that belongs to the same
+   process can be read along with it.
+
+   Pages that compress well are kept in the compressed swap cache
+   (see zswap.c) instead of being written to the device, under the
+   same slot numbers, so only incompressible pages and pages that
+   the cache has written back as cold ever reach the device. */
+
+/* A used swap slot. */
+struct swap_slot
+  {
+    struct page *page;          /* Page held in the slot. */
+    size_t run;                 /* First slot of the run written with
+                                   this one. */
+  };
+
+/* The swap device, or a null pointer if there is none. */
+static struct block *swap_device;
+
+/* Used swap slots. */
+static struct bitmap *swap_bitmap;
+static struct swap_slot *swap_slots;
+
+/* Protects swap_bitmap and swap_slots. */
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long pages_out;     /* Pages written to swap. */
+static long long runs_out;      /* Runs of consecutive slots written. */
+static long long pages_in;      /* Pages read from swap. */
+static long long pages_ahead;   /* Pages read ahead of a fault. */
+
+/* Sets up swap on the BLOCK_SWAP device, if there is one.
+   Without a swap device, only pages that can be reloaded from
+   files can be evicted. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    printf ("swap: no swap device, swapping disabled\n");
+  else
+    slot_cnt = block_size (swap_device) / SWAP_SLOT_SECTORS;
+
+  swap_bitmap = bitmap_create (slot_cnt);
+  swap_slots = malloc (sizeof *swap_slots * (slot_cnt > 0 ? slot_cnt : 1));
+  if (swap_bitmap == NULL || swap_slots == NULL)
+    PANIC ("couldn't create swap bitmap");
+  if (swap_device != NULL)
+    zswap_init ();
+}
+
+/* Initializes BATCH as empty. */
+void
+swap_batch_init (struct swap_batch *batch)
+{
+  batch->cnt = 0;
+  sema_init (&batch->done, 0);
+}
+
+/* Adds page P, whose contents are at KPAGE, to BATCH.  When the
+   batch is written, P is given a swap slot.  A full batch is
+   written out first. */
+void
+swap_batch_add (struct swap_batch *batch, struct page *p, void *kpage)
+{
+  if (batch->cnt >= SWAP_CLUSTER)
+    swap_batch_write (batch);
+  batch->pages[batch->cnt] = p;
+  batch->kpages[batch->cnt] = kpage;
+  batch->cnt++;
+}
+
+/* Wakes up the thread waiting for the batch that REQ is part of. */
+static void
+transfer_done (struct block_request *req)
+{
+  sema_up (req->aux);
+}
+
+/* Submits a transfer of the page at KPAGE to or from the swap
+   slot starting at SECTOR, as part of BATCH, using REQ. */
+static void
+submit_page (struct swap_batch *batch, struct block_request *req,
+             block_sector_t sector, void *kpage, bool write)
+{
+  req->sector = sector;
+  req->cnt = SWAP_SLOT_SECTORS;
+  req->buffer = kpage;
+  req->write = write;
+  req->done = transfer_done;
+  req->aux = &batch->done;
+  block_submit (swap_device, req);
+}
+
+/* Writes the pages in BATCH to swap and empties it.  Each page
+   that is written has its `sector' set to its slot; if swap fills
+   up, the remaining pages keep SWAP_NONE. */
+void
+swap_batch_write (struct swap_batch *batch)
+{
+  size_t first, run, i;
+  size_t written = 0;
+  size_t submitted = 0;
+
+  if (batch->cnt == 0)
+    return;
+
+  lock_acquire (&swap_lock);
+  first = bitmap_scan_and_flip (swap_bitmap, 0, batch->cnt, false);
+  run = first;
+  for (i = 0; i < batch->cnt; i++)
+    {
+      size_t slot;
+
+      /* Fall back to scattered slots if there is no run long
+         enough for the whole batch. */
+      if (first != BITMAP_ERROR)
+        slot = first + i;
+      else
+        {
+          slot = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
+          if (slot == BITMAP_ERROR)
+            break;
+          run = slot;
+        }
+      swap_slots[slot].page = batch->pages[i];
+      swap_slots[slot].run = run;
+      batch->pages[i]->sector = slot * SWAP_SLOT_SECTORS;
+      written++;
+    }
+  pages_out += written;
+  runs_out += first != BITMAP_ERROR ? 1 : written;
+  lock_release (&swap_lock);
+
+  for (i = 0; i < written; i++)
+    {
+      block_sector_t sector = batch->pages[i]->sector;
+      if (!zswap_store (sector / SWAP_SLOT_SECTORS, batch->kpages[i]))
+        submit_page (batch, &batch->reqs[submitted++], sector,
+                     batch->kpages[i], true);
+    }
+  for (i = 0; i < submitted; i++)
+    sema_down (&batch->done);
+  batch->cnt = 0;
+}
+
+/* Reads the pages in BATCH from their swap slots, frees the
+   slots, and empties the batch.  The first page is the one that
+   faulted; the rest are read ahead. */
+void
+swap_batch_read (struct swap_batch *batch)
+{
+  size_t submitted = 0;
+  size_t i;
+
+  for (i = 0; i < batch->cnt; i++)
+    {
+      block_sector_t sector = batch->pages[i]->sector;
+      ASSERT (sector != SWAP_NONE);
+      if (!zswap_load (sector / SWAP_SLOT_SECTORS, batch->kpages[i]))
+        submit_page (batch, &batch->reqs[submitted++], sector,
+                     batch->kpages[i], false);
+    }
+  for (i = 0; i < submitted; i++)
+    sema_down (&batch->done);
+
+  for (i = 0; i < batch->cnt; i++)
+    {
+      swap_free (batch->pages[i]->sector);
+      batch->pages[i]->sector = SWAP_NONE;
+    }
+
+  lock_acquire (&swap_lock);
+  pages_in += batch->cnt;
+  if (batch->cnt > 1)
+    pages_ahead += batch->cnt - 1;
+  lock_release (&swap_lock);
+  batch->cnt = 0;
+}
+
+/* Writes the CNT pages KPAGES[I] to swap slots SLOTS[I] on the
+   device as one batch and waits for the writes to finish.  Used
+   by the compressed swap cache to write back its entries. */
+void
+swap_write_slots (const size_t slots[], void *kpages[], size_t cnt)
+{
+  struct swap_batch batch;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  swap_batch_init (&batch);
+  for (i = 0; i < cnt; i++)
+    submit_page (&batch, &batch.reqs[i], slots[i] * SWAP_SLOT_SECTORS,
+                 kpages[i], true);
+  for (i = 0; i < cnt; i++)
+    sema_down (&batch.done);
+}
+
+/* Stores in PAGES up to MAX pages of the process with page
+   directory PAGEDIR, other than the one in it, that were written
+   to swap in the same run as the slot starting at SECTOR, and
+   returns the number stored.  These are good candidates for
+   reading ahead.  Pages that are still being written out, and so
+   still have their frames, are left out. */
+size_t
+swap_neighbors (block_sector_t sector, uint32_t *pagedir,
+                struct page **pages, size_t max)
+{
+  size_t slot = sector / SWAP_SLOT_SECTORS;
+  size_t run, i;
+  size_t cnt = 0;
+
+  lock_acquire (&swap_lock);
+  run = swap_slots[slot].run;
+  for (i = run; i < run + SWAP_CLUSTER && cnt < max; i++)
+    if (i != slot && i < bitmap_size (swap_bitmap)
+        && bitmap_test (swap_bitmap, i)
+        && swap_slots[i].run == run
+        && swap_slots[i].page->pagedir == pagedir
+        && swap_slots[i].page->frame == NULL)
+      pages[cnt++] = swap_slots[i].page;
+  lock_release (&swap_lock);
+  return cnt;
+}
+
+/* Frees the swap slot starting at SECTOR without reading it. */
+void
+swap_free (block_sector_t sector)
+{
+  size_t slot = sector / SWAP_SLOT_SECTORS;
+
+  ASSERT (sector % SWAP_SLOT_SECTORS == 0);
+
+  zswap_drop (slot);
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_bitmap, slot));
+  bitmap_reset (swap_bitmap, slot);
+  swap_slots[slot].page = NULL;
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  int64_t secs = timer_ticks () / TIMER_FREQ;
+
+  if (swap_device == NULL)
+    return;
+  if (secs == 0)
+    secs = 1;
+  printf ("Swap: %lld pages out in %lld runs (%lld pages/s), "
+          "%lld pages in, %lld read ahead (%lld pages/s)\n",
+          pages_out, runs_out, pages_out / secs,
+          pages_in, pages_ahead, pages_in / secs);
+  if (runs_out > 0)
+    printf ("Swap: average run %lld.%02lld pages\n",
+            pages_out / runs_out, pages_out * 100 / runs_out % 100);
+}
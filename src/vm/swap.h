@@ -0,0 +1,44 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+struct page;
+
+/* Sectors in a swap slot, which holds one page. */
+#define SWAP_SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Marks a page that has no swap slot. */
+#define SWAP_NONE ((block_sector_t) -1)
+
+/* Maximum number of pages written to or read from swap together. */
+#define SWAP_CLUSTER 8
+
+/* A group of pages to be written to or read from swap together,
+   so that the block layer can merge the transfers. */
+struct swap_batch
+  {
+    size_t cnt;                                 /* Number of pages. */
+    struct page *pages[SWAP_CLUSTER];           /* The pages. */
+    void *kpages[SWAP_CLUSTER];                 /* Their contents. */
+    struct block_request reqs[SWAP_CLUSTER];    /* Transfers. */
+    struct semaphore done;                      /* Upped per transfer. */
+  };
+
+void swap_init (void);
+void swap_batch_init (struct swap_batch *);
+void swap_batch_add (struct swap_batch *, struct page *, void *kpage);
+void swap_batch_write (struct swap_batch *);
+void swap_batch_read (struct swap_batch *);
+void swap_write_slots (const size_t slots[], void *kpages[], size_t cnt);
+size_t swap_neighbors (block_sector_t, uint32_t *pagedir,
+                       struct page **, size_t max);
+void swap_free (block_sector_t);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */
@@ -0,0 +1,342 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <lz.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/vmalloc.h"
+#include "vm/swap.h"
+
+/* The compressed swap cache is a tier of RAM in front of the swap
+   device.  A page written to swap is compressed first, and if it
+   shrinks to at most ZSWAP_MAX_SIZE bytes, the compressed copy is
+   kept in the cache instead of being written to the device.  The
+   page keeps its swap slot, which names the cache entry, so that
+   the rest of the VM system need not know about the cache.  When
+   the cache fills up, its oldest entries are decompressed and
+   written to their slots on the device to make room, up to
+   SWAP_CLUSTER at a time, as one batch of writes made without
+   holding the cache's lock.  An entry stays in the cache until
+   its write is done, so that a load in the meantime still finds
+   it, and its slot cannot be freed and reused under the write.
+
+   The cache's memory is a pool of pages taken from the kernel pool
+   at startup with vmalloc(), so that they need not be physically
+   contiguous, divided into ZSWAP_UNIT-byte units.  An entry takes
+   a run of consecutive units. */
+
+/* Size of the compressed swap cache, in pages.  Set with the
+   kernel's -zswap option; 0 disables the cache. */
+size_t zswap_pages = 64;
+
+/* Allocation unit in the pool, in bytes. */
+#define ZSWAP_UNIT 64
+
+/* Largest compressed page worth keeping in the cache.  Pages that
+   compress worse than this go straight to the device. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* A compressed page in the cache. */
+struct zswap_entry
+  {
+    size_t slot;                /* Swap slot. */
+    size_t unit;                /* First unit in pool. */
+    size_t size;                /* Compressed size in bytes. */
+    bool writing;               /* Being written to the device? */
+    struct hash_elem hash_elem; /* Element in `entries'. */
+    struct list_elem lru_elem;  /* Element in `lru'. */
+  };
+
+static uint8_t *pool;           /* Pool of compressed pages. */
+static struct bitmap *used_units; /* Units of pool in use. */
+static struct hash entries;     /* Entries, by swap slot. */
+static struct list lru;         /* Entries, least recently stored first. */
+static bool writing_back;       /* Is a writeback in progress? */
+static struct condition writeback_done; /* Signaled when one ends. */
+static struct lock zswap_lock;  /* Protects all of the above. */
+
+/* Scratch memory, under zswap_lock. */
+static uint8_t *compress_buf;   /* Compressed page. */
+static void *lz_work;           /* For lz_compress(). */
+
+/* Decompressed pages being written back, from palloc() rather
+   than the pool so that the device can reach them.  Owned by the
+   thread that set writing_back. */
+static void *writeback_pages[SWAP_CLUSTER];
+
+/* Statistics. */
+static long long stores;        /* Pages stored. */
+static long long rejects;       /* Pages too incompressible to store. */
+static long long hits;          /* Swap-ins found in the cache. */
+static long long misses;        /* Swap-ins read from the device. */
+static long long writebacks;    /* Entries written to the device. */
+static long long stored_bytes;  /* Total compressed size of stores. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Sets up the compressed swap cache with zswap_pages pages.
+   If the kernel pool cannot spare that many, uses as many as it
+   can. */
+void
+zswap_init (void)
+{
+  bool have_pages = true;
+  size_t i;
+
+  lock_init (&zswap_lock);
+  cond_init (&writeback_done);
+  hash_init (&entries, entry_hash, entry_less, NULL);
+  list_init (&lru);
+  if (zswap_pages == 0)
+    return;
+
+  while ((pool = vmalloc (zswap_pages * PGSIZE)) == NULL
+         && zswap_pages > 1)
+    zswap_pages /= 2;
+  compress_buf = palloc_get_page (0);
+  lz_work = malloc (LZ_WORK_SIZE);
+  used_units = bitmap_create (zswap_pages * PGSIZE / ZSWAP_UNIT);
+  for (i = 0; i < SWAP_CLUSTER; i++)
+    if ((writeback_pages[i] = palloc_get_page (0)) == NULL)
+      have_pages = false;
+  if (pool == NULL || compress_buf == NULL || lz_work == NULL
+      || used_units == NULL || !have_pages)
+    {
+      printf ("zswap: out of memory, compressed swap cache disabled\n");
+      zswap_pages = 0;
+      return;
+    }
+  printf ("zswap: %zu kB compressed swap cache\n",
+          zswap_pages * PGSIZE / 1024);
+}
+
+/* Returns the entry for SLOT, or a null pointer if there is none.
+   zswap_lock must be held. */
+static struct zswap_entry *
+find_entry (size_t slot)
+{
+  struct zswap_entry key;
+  struct hash_elem *e;
+
+  key.slot = slot;
+  e = hash_find (&entries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct zswap_entry, hash_elem) : NULL;
+}
+
+/* Removes entry Z, which is not on the LRU list, from the cache
+   and frees it.  zswap_lock must be held. */
+static void
+free_entry (struct zswap_entry *z)
+{
+  hash_delete (&entries, &z->hash_elem);
+  bitmap_set_multiple (used_units, z->unit, DIV_ROUND_UP (z->size, ZSWAP_UNIT),
+                       false);
+  free (z);
+}
+
+/* Removes entry Z, which must not be being written back, from the
+   cache and frees it.  zswap_lock must be held. */
+static void
+remove_entry (struct zswap_entry *z)
+{
+  ASSERT (!z->writing);
+  list_remove (&z->lru_elem);
+  free_entry (z);
+}
+
+/* Decompresses entry Z into the page at KPAGE.  zswap_lock must be
+   held. */
+static void
+decompress_entry (struct zswap_entry *z, void *kpage)
+{
+  if (!lz_decompress (pool + z->unit * ZSWAP_UNIT, z->size, kpage, PGSIZE))
+    PANIC ("zswap: corrupt entry for swap slot %zu", z->slot);
+}
+
+/* Writes up to SWAP_CLUSTER of the oldest entries in the cache to
+   their slots on the swap device and removes them, or, if another
+   thread is already doing so, waits for it to finish.  Either way,
+   space may have been freed in the pool, and true is returned;
+   false means that the cache is empty.  zswap_lock must be held;
+   it is released during the writes. */
+static bool
+write_back_oldest (void)
+{
+  struct zswap_entry *batch[SWAP_CLUSTER];
+  size_t slots[SWAP_CLUSTER];
+  size_t cnt = 0;
+  size_t i;
+
+  if (writing_back)
+    {
+      cond_wait (&writeback_done, &zswap_lock);
+      return true;
+    }
+  if (list_empty (&lru))
+    return false;
+
+  while (cnt < SWAP_CLUSTER && !list_empty (&lru))
+    {
+      struct zswap_entry *z = list_entry (list_pop_front (&lru),
+                                          struct zswap_entry, lru_elem);
+      z->writing = true;
+      decompress_entry (z, writeback_pages[cnt]);
+      batch[cnt] = z;
+      slots[cnt] = z->slot;
+      cnt++;
+    }
+  writing_back = true;
+  lock_release (&zswap_lock);
+
+  swap_write_slots (slots, writeback_pages, cnt);
+
+  lock_acquire (&zswap_lock);
+  for (i = 0; i < cnt; i++)
+    free_entry (batch[i]);
+  writebacks += cnt;
+  writing_back = false;
+  cond_broadcast (&writeback_done, &zswap_lock);
+  return true;
+}
+
+/* Tries to store a compressed copy of the page at KPAGE in the
+   cache, as the contents of swap slot SLOT, writing older entries
+   to the device if necessary to make room.  Returns true if
+   successful, false if the page should be written to the device
+   because it does not compress well or the cache is disabled. */
+bool
+zswap_store (size_t slot, const void *kpage)
+{
+  struct zswap_entry *z;
+  size_t size, units, unit;
+
+  if (zswap_pages == 0)
+    return false;
+
+  z = malloc (sizeof *z);
+  if (z == NULL)
+    return false;
+
+  /* Writing back releases the lock, letting other threads use
+     compress_buf, so compress again after each try. */
+  lock_acquire (&zswap_lock);
+  for (;;)
+    {
+      size = lz_compress (kpage, PGSIZE, compress_buf, ZSWAP_MAX_SIZE,
+                          lz_work);
+      if (size == 0)
+        {
+          rejects++;
+          lock_release (&zswap_lock);
+          free (z);
+          return false;
+        }
+
+      units = DIV_ROUND_UP (size, ZSWAP_UNIT);
+      unit = bitmap_scan_and_flip (used_units, 0, units, false);
+      if (unit != BITMAP_ERROR)
+        break;
+      if (!write_back_oldest ())
+        {
+          lock_release (&zswap_lock);
+          free (z);
+          return false;
+        }
+    }
+
+  memcpy (pool + unit * ZSWAP_UNIT, compress_buf, size);
+  z->slot = slot;
+  z->unit = unit;
+  z->size = size;
+  z->writing = false;
+  hash_insert (&entries, &z->hash_elem);
+  list_push_back (&lru, &z->lru_elem);
+  stores++;
+  stored_bytes += size;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* If swap slot SLOT is in the cache, decompresses it into KPAGE,
+   removes it from the cache, and returns true.  Otherwise, returns
+   false, and the page must be read from the device.  An entry
+   being written back is left for the write to remove. */
+bool
+zswap_load (size_t slot, void *kpage)
+{
+  struct zswap_entry *z;
+
+  lock_acquire (&zswap_lock);
+  z = find_entry (slot);
+  if (z != NULL)
+    {
+      decompress_entry (z, kpage);
+      if (!z->writing)
+        remove_entry (z);
+      hits++;
+    }
+  else
+    misses++;
+  lock_release (&zswap_lock);
+  return z != NULL;
+}
+
+/* Discards swap slot SLOT from the cache, if it is there.  If it
+   is being written back, waits for the write to finish, so that
+   the slot can be reused once this returns. */
+void
+zswap_drop (size_t slot)
+{
+  struct zswap_entry *z;
+
+  lock_acquire (&zswap_lock);
+  while ((z = find_entry (slot)) != NULL && z->writing)
+    cond_wait (&writeback_done, &zswap_lock);
+  if (z != NULL)
+    remove_entry (z);
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap cache statistics. */
+void
+zswap_print_stats (void)
+{
+  if (zswap_pages == 0)
+    return;
+  printf ("Zswap: %lld pages stored (%lld%% of original size), "
+          "%lld incompressible, %lld written back\n",
+          stores, stores > 0 ? stored_bytes * 100 / (stores * PGSIZE) : 0,
+          rejects, writebacks);
+  printf ("Zswap: %lld hits, %lld misses, %lld%% hit rate\n",
+          hits, misses,
+          hits + misses > 0 ? hits * 100 / (hits + misses) : 0);
+}
+
+/* Returns a hash value for entry Z. */
+static unsigned
+entry_hash (const struct hash_elem *z_, void *aux UNUSED)
+{
+  const struct zswap_entry *z = hash_entry (z_, struct zswap_entry,
+                                            hash_elem);
+  return hash_int (z->slot);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct zswap_entry *a = hash_entry (a_, struct zswap_entry,
+                                            hash_elem);
+  const struct zswap_entry *b = hash_entry (b_, struct zswap_entry,
+                                            hash_elem);
+  return a->slot < b->slot;
+}
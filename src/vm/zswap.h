@@ -0,0 +1,16 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of the compressed swap cache, in pages. */
+extern size_t zswap_pages;
+
+void zswap_init (void);
+bool zswap_store (size_t slot, const void *kpage);
+bool zswap_load (size_t slot, void *kpage);
+void zswap_drop (size_t slot);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */